@@ -0,0 +1,203 @@
+#include "BatonBench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include <folly/Benchmark.h>
+#include <folly/io/Cursor.h>
+#include <quic/codec/QuicInteger.h>
+
+#include "DeviousBaton.h"
+
+namespace
+{
+    using Clock        = std::chrono::steady_clock;
+    using BatonEncoder = ::devious::BatonEncoder;
+    using BatonParser  = ::devious::DeviousBaton;
+    using MessageState = BatonParser::BatonMessageState;
+
+    // About what one QUIC packet carries of a stream
+    constexpr size_t kMtuChunkSize = 1200;
+
+    // The encoder the handlers used before BatonEncoder: one allocation and a fill of
+    // the whole padding per message
+    std::unique_ptr<folly::IOBuf> fillBatonMessage(uint64_t padLen, uint8_t baton)
+    {
+        auto buffer = folly::IOBuf::create(padLen + 9);
+        folly::io::Appender cursor(buffer.get(), 0);
+        quic::encodeQuicInteger(padLen,
+                                [&](auto value)
+                                {
+                                    cursor.writeBE(value);
+                                });
+        memset(buffer->writableTail(), 'a', padLen);
+        buffer->append(padLen);
+        buffer->writableTail()[0] = baton;
+        buffer->append(1);
+        return buffer;
+    }
+
+    // Average nanoseconds per call of fn(i) over iterations calls
+    template <class Fn>
+    double measureNs(uint32_t iterations, Fn&& fn)
+    {
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            fn(i);
+        }
+        std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+        return elapsed.count() / iterations;
+    }
+
+    template <class Encode>
+    void benchEncoder(const char* name, uint32_t iterations, uint64_t padLen, Encode&& encode)
+    {
+        auto ns = measureNs(iterations,
+                            [&](uint32_t i)
+                            {
+                                auto message = encode(padLen, static_cast<uint8_t>(i));
+                                folly::doNotOptimizeAway(message->computeChainDataLength());
+                            });
+        LOG(INFO) << "baton encode " << name << " padding=" << padLen << ": " << ns
+                  << " ns/message";
+    }
+
+    // Bytes [begin, end) of a contiguous message, sharing its buffer
+    std::unique_ptr<folly::IOBuf> slice(const folly::IOBuf& message, size_t begin, size_t end)
+    {
+        auto piece = message.cloneOne();
+        piece->trimStart(begin);
+        piece->trimEnd(message.length() - end);
+        return piece;
+    }
+
+    // Delivers message in two reads split at byte split, FIN on the second; returns
+    // whether the parser finished with the expected baton
+    bool parseSplit(BatonParser& parser, const folly::IOBuf& message, size_t split, uint8_t baton)
+    {
+        MessageState state;
+        return parser.onBatonMessageData(state, slice(message, 0, split), false).hasValue() &&
+               parser.onBatonMessageData(state, slice(message, split, message.length()), true)
+                   .hasValue() &&
+               state.state == MessageState::DONE && state.baton == baton;
+    }
+
+    // Delivers message in reads of chunkSize bytes, FIN on the last
+    bool parseChunked(BatonParser& parser,
+                      const folly::IOBuf& message,
+                      size_t chunkSize,
+                      uint8_t baton)
+    {
+        MessageState state;
+        for (size_t offset = 0; offset < message.length(); offset += chunkSize)
+        {
+            auto end = std::min(offset + chunkSize, message.length());
+            bool fin = end == message.length();
+            if (parser.onBatonMessageData(state, slice(message, offset, end), fin).hasError())
+            {
+                return false;
+            }
+        }
+        return state.state == MessageState::DONE && state.baton == baton;
+    }
+
+    // Parses a message split at every byte boundary, then one byte at a time. The
+    // padding lengths cover one, two and four byte varints, so some splits land
+    // inside the varint and go through padLenBytes.
+    bool checkSplitParsing(BatonParser& parser)
+    {
+        const uint64_t padLens[] = {0, 63, 64, BatonEncoder::kStreamPadLen, 16383, 16384};
+        for (auto padLen : padLens)
+        {
+            auto baton   = static_cast<uint8_t>(padLen % 255 + 1);
+            auto message = BatonEncoder::encodeContiguous(padLen, baton);
+            for (size_t split = 0; split <= message->length(); ++split)
+            {
+                if (!parseSplit(parser, *message, split, baton))
+                {
+                    LOG(ERROR) << "baton parse failed: padding=" << padLen << " split at byte "
+                               << split;
+                    return false;
+                }
+            }
+            if (!parseChunked(parser, *message, 1, baton))
+            {
+                LOG(ERROR) << "baton parse failed: padding=" << padLen << " one byte per read";
+                return false;
+            }
+        }
+        LOG(INFO) << "baton parse: every split point parsed correctly";
+        return true;
+    }
+
+    template <class Parse>
+    void benchParser(const char* name, uint32_t iterations, size_t length, Parse&& parse)
+    {
+        auto ns = measureNs(iterations,
+                            [&](uint32_t)
+                            {
+                                folly::doNotOptimizeAway(parse());
+                            });
+        LOG(INFO) << "baton parse " << name << " length=" << length << ": " << ns
+                  << " ns/message";
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    int runBatonBench(const HQToolClientParams& params)
+    {
+        auto iterations = params.batonBenchIterations;
+        LOG(INFO) << "Running " << iterations << " iterations per baton benchmark";
+
+        for (auto padLen : {devious::BatonEncoder::kStreamPadLen,
+                            devious::BatonEncoder::kDatagramPadLen})
+        {
+            benchEncoder("fill", iterations, padLen, fillBatonMessage);
+        }
+        benchEncoder("chain",
+                     iterations,
+                     devious::BatonEncoder::kStreamPadLen,
+                     devious::BatonEncoder::encodeChain);
+        benchEncoder("contiguous",
+                     iterations,
+                     devious::BatonEncoder::kDatagramPadLen,
+                     devious::BatonEncoder::encodeContiguous);
+
+        // The parser only touches the state passed in, so no session is needed
+        BatonParser parser(nullptr, BatonParser::Mode::SERVER, nullptr);
+        if (!checkSplitParsing(parser))
+        {
+            return 1;
+        }
+        auto message = BatonEncoder::encodeContiguous(BatonEncoder::kStreamPadLen, 0);
+        auto length  = message->length();
+        const std::pair<const char*, size_t> chunkings[] = {
+            {"whole", length},
+            {"mtu", kMtuChunkSize},
+            {"bytewise", 1},
+        };
+        for (auto [name, chunkSize] : chunkings)
+        {
+            benchParser(name,
+                        iterations,
+                        length,
+                        [&, chunkSize = chunkSize]
+                        {
+                            return parseChunked(parser, *message, chunkSize, 0);
+                        });
+        }
+        // Two byte varint split after its first byte
+        benchParser("split-varint",
+                    iterations,
+                    length,
+                    [&]
+                    {
+                        return parseSplit(parser, *message, 1, 0);
+                    });
+        return 0;
+    }
+}  // namespace quic::samples
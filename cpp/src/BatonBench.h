@@ -0,0 +1,20 @@
+#pragma once
+
+#include "HQCommandLine.h"
+
+namespace quic::samples
+{
+    /**
+     * In-process microbenchmark of the devious-baton message encoder and parser.
+     *
+     * Encodes batonBenchIterations stream and datagram sized messages with the
+     * allocate-and-fill path the handlers used before BatonEncoder and with
+     * BatonEncoder itself, and logs nanoseconds per message for each. Then checks
+     * that the parser accepts messages split at every byte boundary, and times it
+     * on a stream message delivered whole, in MTU sized reads, one byte per read and
+     * split inside the padding length. No network.
+     *
+     * Returns 0, or 1 if a split message fails to parse.
+     */
+    int runBatonBench(const HQToolClientParams& params);
+}  // namespace quic::samples
@@ -0,0 +1,99 @@
+#include "CertCompression.h"
+
+#include <fizz/compression/ZlibCertificateCompressor.h>
+#include <fizz/compression/ZstdCertificateCompressor.h>
+#include <fizz/record/Types.h>
+#include <glog/logging.h>
+#include <algorithm>
+
+namespace
+{
+    using namespace quic::samples;
+
+    size_t getIndex(fizz::CertificateCompressionAlgorithm algo)
+    {
+        return std::find(kCertCompressionAlgorithms.begin(),
+                         kCertCompressionAlgorithms.end(),
+                         algo) -
+               kCertCompressionAlgorithms.begin();
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    std::vector<std::shared_ptr<fizz::CertificateCompressor>> makeCertCompressors()
+    {
+        return {std::make_shared<fizz::ZstdCertificateCompressor>(19),
+                std::make_shared<fizz::ZlibCertificateCompressor>(9)};
+    }
+
+    CompressionCountingCert::CompressionCountingCert(std::shared_ptr<fizz::SelfCert> selfCert) :
+        cert(std::move(selfCert))
+    {
+        auto uncompressedSize = fizz::encode(cert->getCertMessage())->computeChainDataLength();
+        for (size_t i = 0; i < kCertCompressionAlgorithms.size(); ++i)
+        {
+            auto compressedSize =
+                fizz::encode(cert->getCompressedCert(kCertCompressionAlgorithms[i]))
+                    ->computeChainDataLength();
+            savings[i] = uncompressedSize > compressedSize ? uncompressedSize - compressedSize
+                                                           : 0;
+            LOG(INFO) << "Certificate " << cert->getIdentity() << ": "
+                      << fizz::toString(kCertCompressionAlgorithms[i]) << " " << uncompressedSize
+                      << " -> " << compressedSize << " bytes";
+        }
+    }
+
+    std::string CompressionCountingCert::getIdentity() const
+    {
+        return cert->getIdentity();
+    }
+
+    std::vector<std::string> CompressionCountingCert::getAltIdentities() const
+    {
+        return cert->getAltIdentities();
+    }
+
+    std::vector<fizz::SignatureScheme> CompressionCountingCert::getSigSchemes() const
+    {
+        return cert->getSigSchemes();
+    }
+
+    fizz::CertificateMsg CompressionCountingCert::getCertMessage(
+        fizz::Buf certificateRequestContext) const
+    {
+        uncompressed.fetch_add(1, std::memory_order_relaxed);
+        return cert->getCertMessage(std::move(certificateRequestContext));
+    }
+
+    fizz::CompressedCertificate CompressionCountingCert::getCompressedCert(
+        fizz::CertificateCompressionAlgorithm algo) const
+    {
+        auto index = getIndex(algo);
+        if (index < kCertCompressionAlgorithms.size())
+        {
+            compressed[index].fetch_add(1, std::memory_order_relaxed);
+            bytesSaved[index].fetch_add(savings[index], std::memory_order_relaxed);
+        }
+        return cert->getCompressedCert(algo);
+    }
+
+    fizz::Buf CompressionCountingCert::sign(fizz::SignatureScheme scheme,
+                                            fizz::CertificateVerifyContext context,
+                                            folly::ByteRange toBeSigned) const
+    {
+        return cert->sign(scheme, context, toBeSigned);
+    }
+
+    CertCompressionStats CompressionCountingCert::getStats()
+    {
+        CertCompressionStats stats;
+        stats.uncompressed = uncompressed.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kCertCompressionAlgorithms.size(); ++i)
+        {
+            stats.compressed[i] = compressed[i].load(std::memory_order_relaxed);
+            stats.bytesSaved[i] = bytesSaved[i].load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+}  // namespace quic::samples
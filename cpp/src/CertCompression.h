@@ -0,0 +1,70 @@
+#pragma once
+
+#include <fizz/compression/CertificateCompressor.h>
+#include <fizz/protocol/Certificate.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace quic::samples
+{
+    // Server preference order, fizz picks the first one the client also offers
+    constexpr std::array kCertCompressionAlgorithms = {
+        fizz::CertificateCompressionAlgorithm::zstd,
+        fizz::CertificateCompressionAlgorithm::zlib,
+    };
+
+    struct CertCompressionStats
+    {
+        // Handshakes that sent the certificate chain uncompressed
+        uint64_t uncompressed = 0;
+        // Per kCertCompressionAlgorithms entry
+        std::array<uint64_t, kCertCompressionAlgorithms.size()> compressed {};
+        std::array<uint64_t, kCertCompressionAlgorithms.size()> bytesSaved {};
+    };
+
+    // One compressor per kCertCompressionAlgorithms entry, at their highest levels since
+    // certificates are compressed once at load time
+    std::vector<std::shared_ptr<fizz::CertificateCompressor>> makeCertCompressors();
+
+    /**
+     * Counts which certificate message every handshake sends and the bytes compression
+     * saved on it. The wrapped certificate must be precompressed for every
+     * kCertCompressionAlgorithms entry, see makeCertCompressors().
+     */
+    class CompressionCountingCert : public fizz::SelfCert
+    {
+    public:
+        explicit CompressionCountingCert(std::shared_ptr<fizz::SelfCert> cert);
+
+        std::string getIdentity() const override;
+
+        std::vector<std::string> getAltIdentities() const override;
+
+        std::vector<fizz::SignatureScheme> getSigSchemes() const override;
+
+        fizz::CertificateMsg getCertMessage(
+            fizz::Buf certificateRequestContext = nullptr) const override;
+
+        fizz::CompressedCertificate getCompressedCert(
+            fizz::CertificateCompressionAlgorithm algo) const override;
+
+        fizz::Buf sign(fizz::SignatureScheme scheme,
+                       fizz::CertificateVerifyContext context,
+                       folly::ByteRange toBeSigned) const override;
+
+        static CertCompressionStats getStats();
+
+    private:
+        std::shared_ptr<fizz::SelfCert> cert;
+        // Encoded uncompressed minus compressed message size, per algorithm
+        std::array<uint64_t, kCertCompressionAlgorithms.size()> savings {};
+
+        static inline std::atomic<uint64_t> uncompressed {0};
+        static inline std::array<std::atomic<uint64_t>, kCertCompressionAlgorithms.size()>
+            compressed {};
+        static inline std::array<std::atomic<uint64_t>, kCertCompressionAlgorithms.size()>
+            bytesSaved {};
+    };
+}  // namespace quic::samples
@@ -0,0 +1,88 @@
+#include "DatagramBatcher.h"
+
+#include <algorithm>
+
+#include "LoopStats.h"
+#include "Tracepoints.h"
+
+namespace quic::samples
+{
+    DatagramBatcher::WorkerStats::WorkerStats()
+    {
+        allStats.wlock()->push_back(this);
+    }
+
+    DatagramBatcher::WorkerStats::~WorkerStats()
+    {
+        auto lockedStats = allStats.wlock();
+        lockedStats->erase(std::remove(lockedStats->begin(), lockedStats->end(), this),
+                           lockedStats->end());
+    }
+
+    DatagramBatcher::DatagramBatcher(folly::EventBase* evb,
+                                     proxygen::WebTransport* transport,
+                                     size_t maxQueuedDatagrams) :
+        eventBase(evb), webTransport(transport), maxQueued(maxQueuedDatagrams),
+        stats(localStats.try_emplace(*evb))
+    {
+        // The queue grows to the largest burst seen and keeps that capacity
+    }
+
+    DatagramBatcher::~DatagramBatcher()
+    {
+        clear();
+    }
+
+    void DatagramBatcher::enqueue(std::unique_ptr<folly::IOBuf> datagram)
+    {
+        if (queue.size() >= maxQueued)
+        {
+            stats.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue.push_back(std::move(datagram));
+        stats.queued.fetch_add(1, std::memory_order_relaxed);
+        if (!isLoopCallbackScheduled())
+        {
+            eventBase->runInLoop(this);
+        }
+    }
+
+    void DatagramBatcher::clear()
+    {
+        cancelLoopCallback();
+        stats.dropped.fetch_add(queue.size(), std::memory_order_relaxed);
+        queue.clear();
+    }
+
+    void DatagramBatcher::runLoopCallback() noexcept
+    {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::WRITE);
+        uint64_t flushed = 0;
+        for (auto& datagram : queue)
+        {
+            SAMPLE_TRACE(datagram_send, datagram->computeChainDataLength());
+            if (webTransport->sendDatagram(std::move(datagram)))
+            {
+                ++flushed;
+            }
+        }
+        stats.flushed.fetch_add(flushed, std::memory_order_relaxed);
+        stats.dropped.fetch_add(queue.size() - flushed, std::memory_order_relaxed);
+        VLOG(6) << "Flushed " << flushed << "/" << queue.size() << " datagrams";
+        queue.clear();
+    }
+
+    DatagramBatcherStats DatagramBatcher::getStats()
+    {
+        DatagramBatcherStats result;
+        auto lockedStats = allStats.rlock();
+        for (auto workerStats : *lockedStats)
+        {
+            result.queued += workerStats->queued.load(std::memory_order_relaxed);
+            result.flushed += workerStats->flushed.load(std::memory_order_relaxed);
+            result.dropped += workerStats->dropped.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+}  // namespace quic::samples
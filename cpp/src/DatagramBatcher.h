@@ -0,0 +1,68 @@
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseLocal.h>
+#include <proxygen/lib/http/webtransport/WebTransport.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace quic::samples
+{
+    struct DatagramBatcherStats
+    {
+        uint64_t queued  = 0;
+        uint64_t flushed = 0;
+        uint64_t dropped = 0;
+    };
+
+    /**
+     * Queues outgoing datagrams of one WebTransport session and hands them to the
+     * transport together once per event loop iteration, so the transport writes
+     * them in a single pass where its batch writer can coalesce them (GSO).
+     * Datagrams beyond maxQueued per iteration are dropped.
+     */
+    class DatagramBatcher : private folly::EventBase::LoopCallback
+    {
+    public:
+        DatagramBatcher(folly::EventBase* evb,
+                        proxygen::WebTransport* webTransport,
+                        size_t maxQueued);
+
+        ~DatagramBatcher() override;
+
+        void enqueue(std::unique_ptr<folly::IOBuf> datagram);
+
+        // Drops everything still queued and cancels the flush; must be called before
+        // the session's WebTransport goes away
+        void clear();
+
+        // Sum over all workers
+        static DatagramBatcherStats getStats();
+
+    private:
+        // Counters of one worker, written only from its EventBase thread
+        struct WorkerStats
+        {
+            WorkerStats();
+            ~WorkerStats();
+
+            std::atomic<uint64_t> queued {0};
+            std::atomic<uint64_t> flushed {0};
+            std::atomic<uint64_t> dropped {0};
+        };
+
+        void runLoopCallback() noexcept override;
+
+        static inline folly::EventBaseLocal<WorkerStats> localStats;
+        static inline folly::Synchronized<std::vector<WorkerStats*>> allStats;
+
+        folly::EventBase* eventBase = nullptr;
+        proxygen::WebTransport* webTransport = nullptr;
+        size_t maxQueued = 0;
+        WorkerStats& stats;
+        std::vector<std::unique_ptr<folly::IOBuf>> queue;
+    };
+}  // namespace quic::samples
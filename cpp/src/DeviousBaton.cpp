@@ -1,33 +1,94 @@
 #include "DeviousBaton.h"
 #include <quic/codec/QuicInteger.h>
+#include <algorithm>
+#include <array>
+
+#include "PaddingSlab.h"
+#include "Tracepoints.h"
 
 using namespace proxygen;
 
 namespace
 {
-    std::unique_ptr<folly::IOBuf> makeBatonMessage(uint64_t padLen, uint8_t baton)
+    // Room for the longest QUIC varint
+    constexpr size_t kMaxPadLenSize = 8;
+
+    constexpr auto kBatonBytes = []
+    {
+        std::array<uint8_t, 256> result {};
+        for (size_t i = 0; i < result.size(); ++i)
+        {
+            result[i] = static_cast<uint8_t>(i);
+        }
+        return result;
+    }();
+
+    std::unique_ptr<folly::IOBuf> makePadLenHeader(uint64_t padLen, size_t capacity)
     {
-        auto buffer = folly::IOBuf::create(padLen + 9);
-        folly::io::Appender cursor(buffer.get(), 1);
+        auto buffer = folly::IOBuf::create(capacity);
+        folly::io::Appender cursor(buffer.get(), 0);
         quic::encodeQuicInteger(padLen,
                                 [&](auto value)
                                 {
                                     cursor.writeBE(value);
                                 });
-        memset(buffer->writableTail(), 'a', padLen);
-        buffer->append(padLen);
+        return buffer;
+    }
+
+    std::unique_ptr<folly::IOBuf> copyBatonMessage(uint64_t padLen, uint8_t baton)
+    {
+        auto buffer = makePadLenHeader(padLen, kMaxPadLenSize + padLen + 1);
+        while (padLen > 0)
+        {
+            auto pieceLength = std::min<uint64_t>(padLen, quic::samples::PaddingSlab::kSlabSize);
+            memcpy(buffer->writableTail(), quic::samples::PaddingSlab::data(), pieceLength);
+            buffer->append(pieceLength);
+            padLen -= pieceLength;
+        }
         buffer->writableTail()[0] = baton;
         buffer->append(1);
         return buffer;
     }
 
-    constexpr uint64_t kStreamPadLen      = 2000;
-    constexpr uint64_t kDatagramPadLen    = 1000;
+    constexpr uint64_t kStreamPadLen      = devious::BatonEncoder::kStreamPadLen;
+    constexpr uint64_t kDatagramPadLen    = devious::BatonEncoder::kDatagramPadLen;
     constexpr uint64_t kMaxParallelBatons = 10;
+
+    // Datagram messages for every baton value, shared read-only by all sessions
+    const std::array<std::unique_ptr<folly::IOBuf>, 256>& getDatagramImages()
+    {
+        static const auto images = []
+        {
+            std::array<std::unique_ptr<folly::IOBuf>, 256> result;
+            for (size_t baton = 0; baton < result.size(); ++baton)
+            {
+                result[baton] = copyBatonMessage(kDatagramPadLen, static_cast<uint8_t>(baton));
+            }
+            return result;
+        }();
+        return images;
+    }
 }  // namespace
 
 namespace devious
 {
+    std::unique_ptr<folly::IOBuf> BatonEncoder::encodeChain(uint64_t padLen, uint8_t baton)
+    {
+        auto message = makePadLenHeader(padLen, kMaxPadLenSize);
+        quic::samples::PaddingSlab::append(*message, padLen);
+        message->prependChain(folly::IOBuf::wrapBuffer(&kBatonBytes[baton], 1));
+        return message;
+    }
+
+    std::unique_ptr<folly::IOBuf> BatonEncoder::encodeContiguous(uint64_t padLen, uint8_t baton)
+    {
+        if (padLen == kDatagramPadLen)
+        {
+            return getDatagramImages()[baton]->cloneOne();
+        }
+        return copyBatonMessage(padLen, baton);
+    }
+
     folly::Expected<folly::Unit, uint16_t> DeviousBaton::onRequest(
         const proxygen::HTTPMessage& request)
     {
@@ -104,11 +165,16 @@ namespace devious
             }
 
             auto id = handle.value()->getID();
-            webTransport->writeStreamData(id,                                      // id
-                                          makeBatonMessage(kStreamPadLen, baton),  // data
-                                          true,                                    // fin
-                                          nullptr                                  // Callback
+            SAMPLE_TRACE(stream_open, id, 0);
+            webTransport->writeStreamData(id,                                               // id
+                                          BatonEncoder::encodeChain(kStreamPadLen, baton),  // data
+                                          true,                                             // fin
+                                          nullptr  // Callback
             );
+            if (observer)
+            {
+                observer->onBatonSent(id, baton);
+            }
         }
     }
 
@@ -169,6 +235,12 @@ namespace devious
                 arrivedOn = PEER_BIDI;
             }
 
+            SAMPLE_TRACE(baton_parse, streamId, state.baton);
+            if (observer)
+            {
+                observer->onBatonReceived(streamId, state.baton);
+            }
+
             auto who = onBatonMessage(streamId, arrivedOn, state.baton);
             if (who.hasError())
             {
@@ -185,31 +257,44 @@ namespace devious
         std::unique_ptr<folly::IOBuf> data,
         bool fin)
     {
-        state.bufQueue.append(std::move(data));
-        folly::io::Cursor cursor(state.bufQueue.front());
-        uint64_t consumed = 0;
-        bool underflow    = false;
+        // Parses straight out of the incoming chain; padding is skipped in place
+        folly::IOBuf empty;
+        folly::io::Cursor cursor(data ? data.get() : &empty);
+        bool underflow = false;
         switch (state.state)
         {
             case BatonMessageState::PAD_LEN:
             {
-                auto padLen = quic::decodeQuicInteger(cursor);
-                if (!padLen)
+                if (state.padLenSize == 0)
+                {
+                    if (cursor.isAtEnd())
+                    {
+                        underflow = true;
+                        break;
+                    }
+                    // The two high bits of the first byte give the encoded length
+                    state.padLenSize = uint8_t(1) << (*cursor.peekBytes().data() >> 6);
+                }
+                state.padLenRead += cursor.pullAtMost(state.padLenBytes.data() + state.padLenRead,
+                                                      state.padLenSize - state.padLenRead);
+                if (state.padLenRead < state.padLenSize)
                 {
                     underflow = true;
                     break;
                 }
-                consumed += padLen->second;
-                state.paddingRemaining = padLen->first;
+                uint64_t padLen = state.padLenBytes[0] & 0x3f;
+                for (uint8_t i = 1; i < state.padLenSize; ++i)
+                {
+                    padLen = (padLen << 8) | state.padLenBytes[i];
+                }
+                state.paddingRemaining = padLen;
                 state.state            = BatonMessageState::PAD;
                 [[fallthrough]];
             }
 
             case BatonMessageState::PAD:
             {
-                auto skipped = cursor.skipAtMost(state.paddingRemaining);
-                state.paddingRemaining -= skipped;
-                consumed += skipped;
+                state.paddingRemaining -= cursor.skipAtMost(state.paddingRemaining);
                 if (state.paddingRemaining > 0)
                 {
                     underflow = true;
@@ -227,15 +312,14 @@ namespace devious
                     break;
                 }
                 state.baton = cursor.read<uint8_t>();
-                LOG(INFO) << "Parsed baton=" << uint64_t(state.baton);
-                consumed += 1;
+                VLOG(4) << "Parsed baton=" << uint64_t(state.baton);
                 state.state = BatonMessageState::DONE;
                 [[fallthrough]];
             }
 
             case BatonMessageState::DONE:
             {
-                if (!state.bufQueue.empty() && !cursor.isAtEnd())
+                if (!cursor.isAtEnd())
                 {
                     return folly::makeUnexpected(BatonSessionError::BRUH);
                 }
@@ -247,7 +331,6 @@ namespace devious
             return folly::makeUnexpected(BatonSessionError::BRUH);
         }
 
-        state.bufQueue.trimStartAtMost(consumed);
         return folly::unit;
     }
 
@@ -291,8 +374,10 @@ namespace devious
     {
         if (baton % 7 == ((mode == Mode::SERVER) ? 0 : 1))
         {
-            LOG(INFO) << "Sending datagram on baton=" << uint64_t(baton);
-            webTransport->sendDatagram(makeBatonMessage(kDatagramPadLen, baton));
+            VLOG(4) << "Sending datagram on baton=" << uint64_t(baton);
+            auto datagram = BatonEncoder::encodeContiguous(kDatagramPadLen, baton);
+            SAMPLE_TRACE(datagram_send, datagram->length());
+            webTransport->sendDatagram(std::move(datagram));
         }
         if (baton == 0)
         {
@@ -310,6 +395,7 @@ namespace devious
                     return folly::makeUnexpected(BatonSessionError::DA_YAMN);
                 }
                 outStreamId = response->writeHandle->getID();
+                SAMPLE_TRACE(stream_open, outStreamId, 1);
                 startReadFn(response->readHandle);
                 break;
             }
@@ -326,15 +412,20 @@ namespace devious
                     return folly::makeUnexpected(BatonSessionError::DA_YAMN);
                 }
                 outStreamId = response.value()->getID();
+                SAMPLE_TRACE(stream_open, outStreamId, 0);
                 break;
             }
         }
 
-        webTransport->writeStreamData(outStreamId,                                 // id
-                                      makeBatonMessage(kStreamPadLen, baton + 1),  // data
-                                      true,                                        // fin
-                                      nullptr                                      // Callback
+        webTransport->writeStreamData(outStreamId,                                          // id
+                                      BatonEncoder::encodeChain(kStreamPadLen, baton + 1),  // data
+                                      true,                                                 // fin
+                                      nullptr  // Callback
         );
+        if (observer)
+        {
+            observer->onBatonSent(outStreamId, uint8_t(baton + 1));
+        }
 
         if (baton + 1 == 0)
         {
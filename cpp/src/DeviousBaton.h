@@ -1,8 +1,9 @@
 #pragma once
 
-#include <folly/io/IOBufQueue.h>
+#include <folly/io/Cursor.h>
 #include <proxygen/lib/http/HTTPMessage.h>
 #include <proxygen/lib/http/webtransport/WebTransport.h>
+#include <array>
 #include <vector>
 
 namespace devious
@@ -23,6 +24,26 @@ namespace devious
         I_LIED   = 0x03,  // Spontaneous reset
     };
 
+    /**
+     * Encodes baton messages: varint padding length, padding, baton byte.
+     *
+     * Neither variant fills padding at encode time. The chain variant references the
+     * shared padding slab and a static table of baton bytes, so only the varint header
+     * is allocated. The contiguous variant is for datagrams, which must be a single
+     * buffer, and hands out clones of per-baton images built once.
+     */
+    class BatonEncoder
+    {
+    public:
+        // Padding the protocol sends in stream and datagram messages
+        static constexpr uint64_t kStreamPadLen   = 2000;
+        static constexpr uint64_t kDatagramPadLen = 1000;
+
+        static std::unique_ptr<folly::IOBuf> encodeChain(uint64_t padLen, uint8_t baton);
+
+        static std::unique_ptr<folly::IOBuf> encodeContiguous(uint64_t padLen, uint8_t baton);
+    };
+
     class DeviousBaton
     {
     public:
@@ -34,11 +55,34 @@ namespace devious
 
         using StartReadFn = std::function<void(proxygen::WebTransport::StreamReadHandle*)>;
 
+        // Notified on every baton hop with the stream it travels on, e.g. to measure
+        // latency under load
+        class Observer
+        {
+        public:
+            virtual ~Observer() = default;
+
+            virtual void onBatonSent(uint64_t streamId, uint8_t baton) noexcept = 0;
+
+            virtual void onBatonReceived(uint64_t streamId, uint8_t baton) noexcept = 0;
+        };
+
         DeviousBaton(proxygen::WebTransport* inWt, Mode inMode, StartReadFn inStartReadFn) :
             webTransport(inWt), mode(inMode), startReadFn(inStartReadFn)
         {
         }
 
+        // Clients build the request before the session exists
+        void setWebTransport(proxygen::WebTransport* inWt) noexcept
+        {
+            webTransport = inWt;
+        }
+
+        void setObserver(Observer* inObserver) noexcept
+        {
+            observer = inObserver;
+        }
+
         folly::Expected<folly::Unit, uint16_t> onRequest(const proxygen::HTTPMessage& request);
 
         void start();
@@ -57,9 +101,12 @@ namespace devious
                 DONE
             };
             State state = PAD_LEN;
-            folly::IOBufQueue bufQueue;
-            uint64_t paddingRemaining;
-            uint8_t baton;
+            // Padding length varint split across reads, nothing else is buffered
+            std::array<uint8_t, 8> padLenBytes {};
+            uint8_t padLenSize        = 0;
+            uint8_t padLenRead        = 0;
+            uint64_t paddingRemaining = 0;
+            uint8_t baton             = 0;
         };
 
         void onStreamData(uint64_t streamId,
@@ -106,5 +153,6 @@ namespace devious
         uint64_t finishedBatons = 0;
         std::vector<uint8_t> batons;
         StartReadFn startReadFn;
+        Observer* observer = nullptr;
     };
 }  // namespace devious
\ No newline at end of file
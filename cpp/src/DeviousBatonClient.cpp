@@ -0,0 +1,512 @@
+#include "DeviousBatonClient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/container/F14Map.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <proxygen/lib/http/session/HQUpstreamSession.h>
+#include <quic/client/QuicClientTransport.h>
+#include <quic/common/events/FollyQuicEventBase.h>
+#include <quic/common/events/HighResQuicTimer.h>
+#include <quic/common/udpsocket/FollyQuicAsyncUDPSocket.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/fizz/client/handshake/FizzClientQuicHandshakeContext.h>
+
+#include "DeviousBaton.h"
+#include "FizzContext.h"
+#include "InsecureVerifierDangerousDoNotUseInProduction.h"
+
+namespace
+{
+    using namespace quic::samples;
+    using Clock = std::chrono::steady_clock;
+
+    // Results of the sessions run by one thread, merged once every thread is done
+    struct LoadStats
+    {
+        std::vector<uint64_t> hopLatenciesUs;
+        std::vector<uint64_t> sessionTimesUs;
+        uint64_t batons           = 0;
+        uint64_t finishedSessions = 0;
+        uint64_t failedSessions   = 0;
+
+        void merge(const LoadStats& other)
+        {
+            hopLatenciesUs.insert(hopLatenciesUs.end(),
+                                  other.hopLatenciesUs.begin(),
+                                  other.hopLatenciesUs.end());
+            sessionTimesUs.insert(sessionTimesUs.end(),
+                                  other.sessionTimesUs.begin(),
+                                  other.sessionTimesUs.end());
+            batons += other.batons;
+            finishedSessions += other.finishedSessions;
+            failedSessions += other.failedSessions;
+        }
+    };
+
+    uint64_t elapsedUs(Clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since)
+            .count();
+    }
+
+    uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+        auto index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+        return sorted[index];
+    }
+
+    /**
+     * One QUIC connection carrying a single baton session.
+     *
+     * Hop latency is the time from sending value v on a stream until v + 1 comes back.
+     * Sent batons are tracked by stream ID, so parallel batons with equal values do not
+     * overwrite each other. The peer answers on the same stream only when it is a
+     * bidirectional one this side opened; otherwise the answer arrives on a new stream
+     * and is matched to the oldest unanswered baton it can follow.
+     *
+     * The session fails if it has not finished within batonTimeout.
+     */
+    class BatonSession :
+        public proxygen::HTTPTransactionHandler,
+        private quic::QuicSocket::ConnectionSetupCallback,
+        private devious::DeviousBaton::Observer,
+        private folly::AsyncTimeout
+    {
+    public:
+        BatonSession(const HQToolClientParams& clientParams,
+                     folly::EventBase* evb,
+                     std::shared_ptr<quic::FollyQuicEventBase> quicEvb,
+                     quic::QuicTimer::SharedPtr timer,
+                     LoadStats& loadStats);
+
+        void start();
+
+        void setTransaction(proxygen::HTTPTransaction* txn) noexcept override
+        {
+            transaction = txn;
+        }
+
+        void detachTransaction() noexcept override;
+
+        void onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept override;
+
+        void onBody(std::unique_ptr<folly::IOBuf> /*chain*/) noexcept override {}
+
+        void onTrailers(std::unique_ptr<proxygen::HTTPHeaders> /*trailers*/) noexcept override {}
+
+        void onEOM() noexcept override;
+
+        void onUpgrade(proxygen::UpgradeProtocol /*protocol*/) noexcept override {}
+
+        void onError(const proxygen::HTTPException& error) noexcept override;
+
+        void onEgressPaused() noexcept override {}
+
+        void onEgressResumed() noexcept override {}
+
+        void onWebTransportBidiStream(
+            proxygen::HTTPCodec::StreamID id,
+            proxygen::WebTransport::BidiStreamHandle stream) noexcept override;
+
+        void onWebTransportUniStream(
+            proxygen::HTTPCodec::StreamID id,
+            proxygen::WebTransport::StreamReadHandle* readHandle) noexcept override;
+
+        void onWebTransportSessionClose(folly::Optional<uint32_t> error) noexcept override;
+
+    private:
+        void onConnectionSetupError(quic::QuicError code) noexcept override;
+
+        void onTransportReady() noexcept override;
+
+        void onBatonSent(uint64_t streamId, uint8_t baton) noexcept override;
+
+        void onBatonReceived(uint64_t streamId, uint8_t baton) noexcept override;
+
+        void timeoutExpired() noexcept override;
+
+        void startRead(proxygen::WebTransport::StreamReadHandle* readHandle);
+
+        void readHandler(proxygen::WebTransport::StreamReadHandle* readHandle,
+                         folly::Try<proxygen::WebTransport::StreamData> streamData);
+
+        void finish();
+
+        const HQToolClientParams& params;
+        folly::EventBase* eventBase = nullptr;
+        std::shared_ptr<quic::FollyQuicEventBase> qEvb;
+        quic::QuicTimer::SharedPtr pacingTimer;
+        LoadStats& stats;
+
+        std::shared_ptr<quic::QuicClientTransport> quicClient;
+        proxygen::HQUpstreamSession* hqSession = nullptr;
+        proxygen::HTTPTransaction* transaction = nullptr;
+        devious::DeviousBaton deviousBaton;
+        folly::F14FastMap<uint64_t, devious::DeviousBaton::BatonMessageState> streams;
+
+        struct PendingHop
+        {
+            uint8_t baton;
+            Clock::time_point sentAt;
+        };
+        // Batons sent and not yet answered, by the stream they went out on
+        folly::F14FastMap<uint64_t, PendingHop> pendingHops;
+        Clock::time_point startTime;
+        bool failed   = false;
+        bool finished = false;
+    };
+
+    BatonSession::BatonSession(const HQToolClientParams& clientParams,
+                               folly::EventBase* evb,
+                               std::shared_ptr<quic::FollyQuicEventBase> quicEvb,
+                               quic::QuicTimer::SharedPtr timer,
+                               LoadStats& loadStats) :
+        folly::AsyncTimeout(evb), params(clientParams), eventBase(evb), qEvb(std::move(quicEvb)),
+        pacingTimer(std::move(timer)), stats(loadStats),
+        deviousBaton(nullptr,
+                     devious::DeviousBaton::Mode::CLIENT,
+                     [this](proxygen::WebTransport::StreamReadHandle* readHandle)
+                     {
+                         startRead(readHandle);
+                     })
+    {
+    }
+
+    void BatonSession::start()
+    {
+        auto transportSettings = params.transportSettings;
+        transportSettings.datagramConfig.enabled = true;
+
+        auto sock   = std::make_unique<quic::FollyQuicAsyncUDPSocket>(qEvb);
+        auto client = std::make_shared<quic::QuicClientTransport>(
+            qEvb,
+            std::move(sock),
+            quic::FizzClientQuicHandshakeContext::Builder()
+                .setFizzClientContext(createFizzClientContext(params, params.earlyData))
+                .setCertificateVerifier(
+                    std::make_unique<proxygen::InsecureVerifierDangerousDoNotUseInProduction>())
+                .setPskCache(params.pskCache)
+                .build());
+        client->setPacingTimer(pacingTimer);
+        client->setHostname(params.host);
+        client->addNewPeerAddress(params.remoteAddress.value());
+        client->setCongestionControllerFactory(
+            std::make_shared<quic::DefaultCongestionControllerFactory>());
+        client->setTransportSettings(transportSettings);
+        client->setSupportedVersions(params.quicVersions);
+
+        quicClient = std::move(client);
+        startTime  = Clock::now();
+        if (params.batonTimeout.count() > 0)
+        {
+            scheduleTimeout(params.batonTimeout);
+        }
+        quicClient->start(this, nullptr);
+    }
+
+    void BatonSession::timeoutExpired() noexcept
+    {
+        LOG(ERROR) << "Baton session timed out after " << params.batonTimeout.count() << " ms";
+        failed = true;
+        if (transaction)
+        {
+            // Detaching the transaction finishes the session
+            transaction->sendAbort();
+            return;
+        }
+        finish();
+        if (!hqSession)
+        {
+            quicClient->setConnectionSetupCallback(nullptr);
+            quicClient->closeNow(
+                quic::QuicError(quic::LocalErrorCode::IDLE_TIMEOUT, "baton session timeout"));
+        }
+    }
+
+    void BatonSession::onConnectionSetupError(quic::QuicError code) noexcept
+    {
+        LOG(ERROR) << "Baton session failed to connect: " << code.message;
+        quicClient->setConnectionSetupCallback(nullptr);
+        failed = true;
+        finish();
+    }
+
+    void BatonSession::onTransportReady() noexcept
+    {
+        wangle::TransportInfo tinfo;
+        hqSession = new proxygen::HQUpstreamSession(params.txnTimeout,
+                                                    params.connectTimeout,
+                                                    nullptr,  // controller
+                                                    tinfo,
+                                                    nullptr);
+        quicClient->setConnectionCallback(hqSession);
+        quicClient->setConnectionSetupCallback(hqSession);
+        hqSession->setSocket(quicClient);
+        hqSession->setEgressSettings({
+            {proxygen::SettingsId::ENABLE_CONNECT_PROTOCOL, 1},
+            {proxygen::SettingsId::_HQ_DATAGRAM_DRAFT_8, 1},
+            {proxygen::SettingsId::_HQ_DATAGRAM, 1},
+            {proxygen::SettingsId::_HQ_DATAGRAM_RFC, 1},
+            {proxygen::SettingsId::ENABLE_WEBTRANSPORT, 1},
+        });
+        hqSession->startNow();
+        hqSession->onTransportReady();
+
+        auto txn = hqSession->newTransaction(this);
+        if (!txn)
+        {
+            LOG(ERROR) << "Could not open the baton CONNECT stream";
+            failed = true;
+            finish();
+            return;
+        }
+
+        auto request = deviousBaton.makeRequest(
+            0,
+            params.batonCount,
+            std::vector<uint8_t>(params.batonCount, params.batonInitial));
+        request.getHeaders().set(proxygen::HTTP_HEADER_HOST, params.host);
+        request.setSecure(true);
+        txn->sendHeaders(request);
+    }
+
+    void BatonSession::onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept
+    {
+        auto webTransport = transaction->getWebTransport();
+        if (message->getStatusCode() != 200 || !webTransport)
+        {
+            LOG(ERROR) << "Baton session rejected: status=" << message->getStatusCode();
+            failed = true;
+            transaction->sendAbort();
+            return;
+        }
+        deviousBaton.setWebTransport(webTransport);
+        deviousBaton.setObserver(this);
+    }
+
+    void BatonSession::onWebTransportBidiStream(
+        proxygen::HTTPCodec::StreamID /*id*/,
+        proxygen::WebTransport::BidiStreamHandle stream) noexcept
+    {
+        startRead(stream.readHandle);
+    }
+
+    void BatonSession::onWebTransportUniStream(
+        proxygen::HTTPCodec::StreamID /*id*/,
+        proxygen::WebTransport::StreamReadHandle* readHandle) noexcept
+    {
+        startRead(readHandle);
+    }
+
+    void BatonSession::onWebTransportSessionClose(folly::Optional<uint32_t> error) noexcept
+    {
+        VLOG(4) << "Baton session close error="
+                << (error ? folly::to<std::string>(*error) : std::string("none"));
+        if (error && *error != 0)
+        {
+            failed = true;
+        }
+        streams.clear();
+        if (transaction && !transaction->isEgressEOMSeen())
+        {
+            transaction->sendEOM();
+        }
+    }
+
+    void BatonSession::onEOM() noexcept
+    {
+        if (transaction && !transaction->isEgressEOMSeen())
+        {
+            transaction->sendEOM();
+        }
+    }
+
+    void BatonSession::onError(const proxygen::HTTPException& error) noexcept
+    {
+        LOG(ERROR) << "Baton session error: " << error.what();
+        failed = true;
+    }
+
+    void BatonSession::detachTransaction() noexcept
+    {
+        transaction = nullptr;
+        streams.clear();
+        finish();
+    }
+
+    void BatonSession::onBatonSent(uint64_t streamId, uint8_t baton) noexcept
+    {
+        // Zero ends the lane, nothing comes back for it
+        if (baton != 0)
+        {
+            pendingHops[streamId] = {baton, Clock::now()};
+        }
+    }
+
+    void BatonSession::onBatonReceived(uint64_t streamId, uint8_t baton) noexcept
+    {
+        ++stats.batons;
+        auto hop = pendingHops.find(streamId);
+        if (hop == pendingHops.end())
+        {
+            for (auto candidate = pendingHops.begin(); candidate != pendingHops.end(); ++candidate)
+            {
+                // Client-opened bidirectional streams carry their own answer
+                bool answeredInPlace = (candidate->first & 0x3) == 0;
+                if (!answeredInPlace && uint8_t(candidate->second.baton + 1) == baton &&
+                    (hop == pendingHops.end() || candidate->second.sentAt < hop->second.sentAt))
+                {
+                    hop = candidate;
+                }
+            }
+        }
+        if (hop != pendingHops.end())
+        {
+            stats.hopLatenciesUs.push_back(elapsedUs(hop->second.sentAt));
+            pendingHops.erase(hop);
+        }
+    }
+
+    void BatonSession::startRead(proxygen::WebTransport::StreamReadHandle* readHandle)
+    {
+        readHandle->awaitNextRead(eventBase,
+                                  [this](auto readHandle, auto streamData)
+                                  {
+                                      readHandler(readHandle, std::move(streamData));
+                                  });
+    }
+
+    void BatonSession::readHandler(proxygen::WebTransport::StreamReadHandle* readHandle,
+                                   folly::Try<proxygen::WebTransport::StreamData> streamData)
+    {
+        auto id = readHandle->getID();
+        if (streamData.hasException())
+        {
+            VLOG(4) << "read error=" << streamData.exception().what();
+            streams.erase(id);
+            return;
+        }
+
+        auto fin = streamData->fin;
+        deviousBaton.onStreamData(id, streams[id], std::move(streamData->data), fin);
+        if (fin)
+        {
+            streams.erase(id);
+        }
+        else
+        {
+            startRead(readHandle);
+        }
+    }
+
+    void BatonSession::finish()
+    {
+        if (finished)
+        {
+            return;
+        }
+        finished = true;
+        cancelTimeout();
+        pendingHops.clear();
+        stats.sessionTimesUs.push_back(elapsedUs(startTime));
+        if (failed)
+        {
+            ++stats.failedSessions;
+        }
+        else
+        {
+            ++stats.finishedSessions;
+        }
+
+        if (hqSession)
+        {
+            hqSession->drain();
+            hqSession->closeWhenIdle();
+        }
+    }
+
+    // Runs every threads-th session starting at first on a private event loop
+    LoadStats runSessions(const HQToolClientParams& params, uint32_t first, uint32_t threads)
+    {
+        LoadStats stats;
+        folly::EventBase evb;
+        auto qEvb = std::make_shared<quic::FollyQuicEventBase>(&evb);
+        quic::QuicTimer::SharedPtr pacingTimer;
+        if (params.transportSettings.pacingEnabled)
+        {
+            pacingTimer = std::make_shared<quic::HighResQuicTimer>(
+                &evb,
+                params.transportSettings.pacingTimerResolution);
+        }
+
+        std::vector<std::unique_ptr<BatonSession>> sessions;
+        for (auto i = first; i < params.batonSessions; i += threads)
+        {
+            sessions.push_back(
+                std::make_unique<BatonSession>(params, &evb, qEvb, pacingTimer, stats));
+            sessions.back()->start();
+        }
+        evb.loop();
+        return stats;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    int runDeviousBatonClient(const HQToolClientParams& params)
+    {
+        auto threads = std::clamp<uint32_t>(params.batonThreads, 1, params.batonSessions);
+        LOG(INFO) << "Running " << params.batonSessions << " baton sessions on " << threads
+                  << " threads against " << params.remoteAddress->describe();
+
+        std::vector<LoadStats> results(threads);
+        std::vector<std::thread> workers;
+        auto startTime = Clock::now();
+        for (uint32_t thread = 0; thread < threads; ++thread)
+        {
+            workers.emplace_back(
+                [&params, &results, thread, threads]
+                {
+                    results[thread] = runSessions(params, thread, threads);
+                });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        auto elapsed = std::max<uint64_t>(elapsedUs(startTime), 1);
+
+        LoadStats total;
+        for (const auto& result : results)
+        {
+            total.merge(result);
+        }
+        std::sort(total.hopLatenciesUs.begin(), total.hopLatenciesUs.end());
+        std::sort(total.sessionTimesUs.begin(), total.sessionTimesUs.end());
+
+        LOG(INFO) << "Baton sessions: " << total.finishedSessions << " finished, "
+                  << total.failedSessions << " failed in " << elapsed / 1000 << " ms";
+        LOG(INFO) << "Batons: " << total.batons << " ("
+                  << total.batons * 1000000 / elapsed << "/s)";
+        LOG(INFO) << "Hop latency us: p50=" << percentile(total.hopLatenciesUs, 0.5)
+                  << " p90=" << percentile(total.hopLatenciesUs, 0.9)
+                  << " p99=" << percentile(total.hopLatenciesUs, 0.99)
+                  << " max=" << percentile(total.hopLatenciesUs, 1.0);
+        LOG(INFO) << "Session time ms: p50=" << percentile(total.sessionTimesUs, 0.5) / 1000
+                  << " p90=" << percentile(total.sessionTimesUs, 0.9) / 1000
+                  << " p99=" << percentile(total.sessionTimesUs, 0.99) / 1000
+                  << " max=" << percentile(total.sessionTimesUs, 1.0) / 1000;
+
+        return total.failedSessions == 0 ? 0 : -1;
+    }
+}  // namespace quic::samples
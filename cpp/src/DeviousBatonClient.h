@@ -0,0 +1,17 @@
+#pragma once
+
+#include "HQCommandLine.h"
+
+namespace quic::samples
+{
+    /**
+     * Load driver for /webtransport/devious-baton.
+     *
+     * Opens batonSessions WebTransport sessions, one QUIC connection each, spread over
+     * batonThreads event loops, runs the baton protocol to completion and logs batons
+     * per second, per-hop latency percentiles and session completion times.
+     *
+     * Returns 0 when every session finished cleanly.
+     */
+    int runDeviousBatonClient(const HQToolClientParams& params);
+}  // namespace quic::samples
@@ -3,13 +3,17 @@
 #include <fizz/backend/openssl/certificate/CertUtils.h>
 #include <fizz/compression/ZlibCertificateDecompressor.h>
 #include <fizz/compression/ZstdCertificateDecompressor.h>
-#include <fizz/server/AeadTicketCipher.h>
 #include <fizz/server/CertManager.h>
-#include <fizz/server/TicketCodec.h>
 #include <folly/FileUtil.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
 #include <folly/Random.h>
+#include <glog/logging.h>
 #include <string>
 
+#include "CertCompression.h"
+#include "ReplayCache.h"
+#include "SignOffload.h"
+
 namespace
 {
     const std::string kDefaultCertData = R"(
@@ -136,7 +140,24 @@ VnFqMCnjdeFhc/LA6rx3ALn2jfDj9jQR0QGRouFA7NbYZFx7Uj3HOw0/
 
 namespace quic::samples
 {
-    FizzServerContextPtr createFizzServerContext(const MyHQServerParams& params)
+    bool loadTicketSecrets(const MyHQServerParams& params, RotatingTicketCipher& ticketCipher)
+    {
+        std::vector<std::string> secrets;
+        if (params.ticketKeyFile.empty())
+        {
+            std::array<uint8_t, 32> ticketSeed;
+            folly::Random::secureRandom(ticketSeed.data(), ticketSeed.size());
+            secrets.emplace_back(ticketSeed.begin(), ticketSeed.end());
+        }
+        else if (!readTicketSecrets(params.ticketKeyFile, secrets))
+        {
+            return false;
+        }
+        return ticketCipher.setTicketSecrets(secrets);
+    }
+
+    FizzServerContextPtr createFizzServerContext(const MyHQServerParams& params,
+                                                 std::shared_ptr<RotatingTicketCipher> ticketCipher)
     {
         std::string certData = kDefaultCertData;
         if (!params.certificateFilePath.empty())
@@ -148,28 +169,57 @@ namespace quic::samples
         {
             folly::readFile(params.keyFilePath.c_str(), keyData);
         }
-        auto cert        = fizz::openssl::CertUtils::makeSelfCert(certData, keyData);
+        std::shared_ptr<folly::CPUThreadPoolExecutor> signExecutor;
+        if (params.signThreads > 0)
+        {
+            signExecutor = std::make_shared<folly::CPUThreadPoolExecutor>(
+                params.signThreads, std::make_shared<folly::NamedThreadFactory>("TlsSign"));
+        }
+        auto wrapCert = [&signExecutor](std::unique_ptr<fizz::SelfCert> selfCert)
+        {
+            std::shared_ptr<fizz::SelfCert> wrapped =
+                std::make_shared<CompressionCountingCert>(std::move(selfCert));
+            if (signExecutor)
+            {
+                wrapped = std::make_shared<OffloadSelfCert>(std::move(wrapped), signExecutor);
+            }
+            return wrapped;
+        };
+
+        // Compressed once here, the RSA chain alone can exceed the amplification limit
+        auto compressors = makeCertCompressors();
+        auto cert = fizz::openssl::CertUtils::makeSelfCert(certData, keyData, compressors);
         auto certManager = std::make_shared<fizz::server::CertManager>();
-        certManager->addCertAndSetDefault(std::move(cert));
+        certManager->addCertAndSetDefault(wrapCert(std::move(cert)));
 
-        auto cert2 =
-            fizz::openssl::CertUtils::makeSelfCert(kPrime256v1CertData, kPrime256v1KeyData);
-        certManager->addCert(std::move(cert2));
+        auto cert2 = fizz::openssl::CertUtils::makeSelfCert(
+            kPrime256v1CertData, kPrime256v1KeyData, compressors);
+        certManager->addCert(wrapCert(std::move(cert2)));
 
         auto serverCtx = std::make_shared<fizz::server::FizzServerContext>();
         serverCtx->setCertManager(certManager);
-        auto ticketCipher = std::make_shared<fizz::server::Aead128GCMTicketCipher<
-            fizz::server::TicketCodec<fizz::server::CertificateStorage::X509>>>(
-            serverCtx->getFactoryPtr(),
-            std::move(certManager));
-        std::array<uint8_t, 32> ticketSeed;
-        folly::Random::secureRandom(ticketSeed.data(), ticketSeed.size());
-        ticketCipher->setTicketSecrets({{folly::range(ticketSeed)}});
-        serverCtx->setTicketCipher(ticketCipher);
+        if (!ticketCipher)
+        {
+            ticketCipher = std::make_shared<RotatingTicketCipher>();
+        }
+        ticketCipher->setContext(serverCtx->getFactoryPtr(), std::move(certManager));
+        if (!loadTicketSecrets(params, *ticketCipher))
+        {
+            LOG(FATAL) << "No usable ticket secrets in " << params.ticketKeyFile;
+        }
+        serverCtx->setTicketCipher(std::move(ticketCipher));
         serverCtx->setClientAuthMode(params.clientAuth);
         serverCtx->setSupportedAlpns(params.supportedAlpns);
+        serverCtx->setSupportedCompressionAlgorithms(
+            {kCertCompressionAlgorithms.begin(), kCertCompressionAlgorithms.end()});
+        // The certificate is picked by the first scheme the client supports, P-256
+        // signatures cost a fraction of RSA-4096 ones
+        serverCtx->setSupportedSigSchemes({fizz::SignatureScheme::ecdsa_secp256r1_sha256,
+                                           fizz::SignatureScheme::ecdsa_secp384r1_sha384,
+                                           fizz::SignatureScheme::ecdsa_secp521r1_sha512,
+                                           fizz::SignatureScheme::rsa_pss_sha256});
         serverCtx->setAlpnMode(fizz::server::AlpnMode::Required);
-        serverCtx->setSendNewSessionTicket(false);
+        serverCtx->setSendNewSessionTicket(true);
         serverCtx->setEarlyDataFbOnly(false);
         serverCtx->setVersionFallbackEnabled(false);
 
@@ -178,7 +228,10 @@ namespace quic::samples
         tolerance.after  = std::chrono::minutes(5);
 
         std::shared_ptr<fizz::server::ReplayCache> replayCache =
-            std::make_shared<fizz::server::AllowAllReplayReplayCache>();
+            std::make_shared<BoundedReplayCache>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(tolerance.after -
+                                                                      tolerance.before),
+                params.replayCacheCapacity);
 
         serverCtx->setEarlyDataSettings(true, tolerance, std::move(replayCache));
 
@@ -4,6 +4,7 @@
 #include <fizz/server/FizzServerContext.h>
 #include <wangle/ssl/SSLContextConfig.h>
 #include "HQParams.h"
+#include "TicketCipher.h"
 
 namespace quic::samples
 {
@@ -12,7 +13,13 @@ namespace quic::samples
 
     using FizzClientContextPtr = std::shared_ptr<fizz::client::FizzClientContext>;
 
-    FizzServerContextPtr createFizzServerContext(const MyHQServerParams& params);
+    // Issues session tickets encrypted with ticketCipher, a private cipher when null
+    FizzServerContextPtr createFizzServerContext(
+        const MyHQServerParams& params,
+        std::shared_ptr<RotatingTicketCipher> ticketCipher = nullptr);
+
+    // Loads params.ticketKeyFile into ticketCipher, random secrets without a key file
+    bool loadTicketSecrets(const MyHQServerParams& params, RotatingTicketCipher& ticketCipher);
 
     FizzClientContextPtr createFizzClientContext(const MyHQBaseParams& params, bool earlyData);
 
@@ -1,6 +1,9 @@
 #include "H2Server.h"
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/synchronization/Baton.h>
 #include <proxygen/httpserver/HTTPTransactionHandlerAdaptor.h>
 #include "FizzContext.h"
+#include "LoopStats.h"
 
 namespace quic::samples
 {
@@ -13,7 +16,11 @@ namespace quic::samples
     {
     }
 
-    void H2Server::SampleHandlerFactory::onServerStart(folly::EventBase* /*evb*/) noexcept {}
+    void H2Server::SampleHandlerFactory::onServerStart(folly::EventBase* evb) noexcept
+    {
+        // Called on each H2 worker thread
+        LoopStats::install(evb);
+    }
 
     void H2Server::SampleHandlerFactory::onServerStop() noexcept {}
 
@@ -31,7 +38,9 @@ namespace quic::samples
 
         serverOptions->threads                  = params.httpServerThreads;
         serverOptions->idleTimeout              = params.httpServerIdleTimeout;
-        serverOptions->shutdownOn               = params.httpServerShutdownOn;
+        // The caller handles every signal on one EventBase and stops the server, since
+        // libevent delivers signals to only one event_base per process
+        serverOptions->shutdownOn.clear();
         serverOptions->enableContentCompression = params.httpServerEnableContentCompression;
         serverOptions->initialReceiveWindow =
             params.transportSettings.advertisedInitialBidiLocalStreamFlowControlWindow;
@@ -39,6 +48,15 @@ namespace quic::samples
             params.transportSettings.advertisedInitialBidiLocalStreamFlowControlWindow;
         serverOptions->receiveSessionWindowSize =
             params.transportSettings.advertisedInitialConnectionFlowControlWindow;
+        if (!params.takeoverSocketPath.empty())
+        {
+            // Lets the successor bind the H2 port while this server drains
+            folly::AsyncServerSocket::UniquePtr socket(new folly::AsyncServerSocket());
+            socket->setReusePortEnabled(true);
+            socket->bind(params.localH2Address.value());
+            socket->listen(serverOptions->listenBacklog);
+            serverOptions->useExistingSocket(std::move(socket));
+        }
         serverOptions->handlerFactories =
             proxygen::RequestHandlerChain()
                 .addThen<SampleHandlerFactory>(std::move(httpTransactionHandlerProvider))
@@ -57,25 +75,39 @@ namespace quic::samples
         return acceptorConfig;
     }
 
-    std::thread H2Server::run(const HQToolServerParams& params,
-                              HTTPTransactionHandlerProvider httpTransactionHandlerProvider)
+    std::unique_ptr<proxygen::HTTPServer> H2Server::create(
+        const HQToolServerParams& params,
+        HTTPTransactionHandlerProvider httpTransactionHandlerProvider)
+    {
+        auto acceptorConfig = createServerAcceptorConfig(params);
+        auto serverOptions =
+            createServerOptions(params, std::move(httpTransactionHandlerProvider));
+        auto server = std::make_unique<proxygen::HTTPServer>(std::move(*serverOptions));
+        server->bind(std::move(*acceptorConfig));
+        return server;
+    }
+
+    std::thread H2Server::run(proxygen::HTTPServer& server,
+                              std::shared_ptr<folly::IOThreadPoolExecutor> ioExecutor)
     {
-        // Start HTTPServer mainloop in a separate thread
+        folly::Baton<> listening;
         std::thread t(
-            [params                         = folly::copy(params),
-             httpTransactionHandlerProvider = std::move(httpTransactionHandlerProvider)]() mutable
+            [&server, &listening, ioExecutor = std::move(ioExecutor)]() mutable
             {
-                {
-                    auto acceptorConfig = createServerAcceptorConfig(params);
-                    auto serverOptions =
-                        createServerOptions(params, std::move(httpTransactionHandlerProvider));
-                    proxygen::HTTPServer server(std::move(*serverOptions));
-                    server.bind(std::move(*acceptorConfig));
-                    server.start();
-                }
-                // HTTPServer traps the SIGINT.  resignal HQServer
-                raise(SIGINT);
+                server.start(
+                    [&listening]
+                    {
+                        listening.post();
+                    },
+                    [](std::exception_ptr error)
+                    {
+                        LOG(FATAL) << "H2 server failed to start: "
+                                   << folly::exceptionStr(error);
+                    },
+                    nullptr,
+                    std::move(ioExecutor));
             });
+        listening.wait();
 
         return t;
     }
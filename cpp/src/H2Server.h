@@ -1,5 +1,6 @@
 #pragma once
 
+#include <folly/executors/IOThreadPoolExecutor.h>
 #include <proxygen/httpserver/HTTPServer.h>
 #include "HQCommandLine.h"
 #include "HQServer.h"
@@ -32,9 +33,15 @@ namespace quic::samples
         using AcceptorConfig = std::vector<proxygen::HTTPServer::IPConfig>;
         static std::unique_ptr<AcceptorConfig> createServerAcceptorConfig(
             const HQToolServerParams& /* params */);
-        // Starts H2 server in a background thread
-        static std::thread run(const HQToolServerParams& params,
-                               HTTPTransactionHandlerProvider httpTransactionHandlerProvider);
+        // Creates a bound H2 server, ready to start()
+        static std::unique_ptr<proxygen::HTTPServer> create(
+            const HQToolServerParams& params,
+            HTTPTransactionHandlerProvider httpTransactionHandlerProvider);
+        // Starts server in a background thread with its acceptors on the event loops of
+        // ioExecutor, or on its own threads when ioExecutor is null, and waits until it is
+        // listening. The thread exits after server.stop()
+        static std::thread run(proxygen::HTTPServer& server,
+                               std::shared_ptr<folly::IOThreadPoolExecutor> ioExecutor);
     };
 
 }  // namespace quic::samples
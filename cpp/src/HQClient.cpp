@@ -15,9 +15,12 @@
 #include <quic/common/udpsocket/FollyQuicAsyncUDPSocket.h>
 #include <quic/congestion_control/CongestionControllerFactory.h>
 #include <quic/fizz/client/handshake/FizzClientQuicHandshakeContext.h>
+#include "BatonBench.h"
+#include "DeviousBatonClient.h"
 #include "FizzContext.h"
 #include "H1QUpstreamSession.h"
 #include "HQLoggerHelper.h"
+#include "HandshakeBench.h"
 #include "InsecureVerifierDangerousDoNotUseInProduction.h"
 
 namespace quic::samples
@@ -357,6 +360,18 @@ namespace quic::samples
 
     int startClient(const HQToolClientParams& params)
     {
+        if (params.batonBenchIterations > 0)
+        {
+            return runBatonBench(params);
+        }
+        if (params.batonSessions > 0)
+        {
+            return runDeviousBatonClient(params);
+        }
+        if (params.handshakeBenchConnections > 0)
+        {
+            return runHandshakeBench(params);
+        }
         HQClient client(params);
         return client.start();
     }
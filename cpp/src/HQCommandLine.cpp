@@ -5,13 +5,74 @@
 #include <proxygen/lib/http/SynchronizedLruQuicPskCache.h>
 #include <proxygen/lib/transport/PersistentQuicPskCache.h>
 #include <quic/QuicConstants.h>
+#include <sched.h>
 
 #include "CurlClient.h"
+#include "ReplayCache.h"
+#include "TicketCipher.h"
+#include "TransportProfiles.h"
+#include "UdpBatchingCalibration.h"
 
 DEFINE_string(host, "127.0.0.1", "HQ server hostname/IP");
 DEFINE_int32(port, 4433, "HQ server port");
 DEFINE_int32(threads, 1, "QUIC Server threads, 0 = nCPUs");
+DEFINE_string(worker_cpus,
+              "",
+              "Comma separated CPUs or ranges (e.g. 0,2,4-7) to pin QUIC workers to, one "
+              "worker per CPU; also steers each worker's UDP socket to its CPU");
+DEFINE_uint32(worker_stats_interval_s,
+              0,
+              "Seconds between per-worker packet count reports, 0 = only on exit");
+DEFINE_string(takeover_socket,
+              "",
+              "Unix socket path to take over the UDP sockets of a running server from, "
+              "then to hand them to the next server on");
+DEFINE_uint32(takeover_forward_port,
+              4435,
+              "Loopback port a server taken over receives its forwarded packets on, the "
+              "next generation uses the port after it");
+DEFINE_uint32(takeover_drain_s,
+              30,
+              "Seconds a server taken over keeps serving its connections before exiting");
+DEFINE_uint32(loop_lag_retry_ms,
+              0,
+              "Smoothed QUIC worker loop lag at which new connections get a stateless retry, "
+              "0 = never");
+DEFINE_uint32(loop_lag_reject_ms,
+              0,
+              "Smoothed QUIC worker loop lag at which new connections are rejected, 0 = never");
+DEFINE_uint32(loop_lag_shed_ms,
+              0,
+              "Smoothed QUIC worker loop lag at which low-priority requests get a 503, "
+              "0 = never");
+DEFINE_bool(unified_event_loops,
+            false,
+            "Run the H2 acceptors on the QUIC worker event loops instead of a separate "
+            "HTTPServer thread pool");
+DEFINE_string(ticket_key_file,
+              "",
+              "File with one hex encoded session ticket secret per line, newest first, shared "
+              "by all server processes; empty = random secrets per process");
+DEFINE_uint32(ticket_key_reload_s,
+              300,
+              "Seconds between reloads of ticket_key_file, 0 = load once at startup");
+DEFINE_uint32(replay_cache_entries,
+              1 << 20,
+              "0-RTT identifiers remembered for replay detection; when full, early data is "
+              "refused until the evicted identifiers have expired");
+DEFINE_uint32(sign_threads,
+              0,
+              "Threads signing TLS handshakes so that QUIC workers do not block on private "
+              "key operations, 0 = sign on the workers");
+DEFINE_string(transport_profiles,
+              "",
+              "JSON file of named transport profiles for new connections, by default and "
+              "per ALPN; reloaded on SIGHUP");
 DEFINE_int32(h2port, 6667, "HTTP/2 server port");
+DEFINE_uint32(h2_idle_timeout_ms,
+              60000,
+              "HTTP/2 connection idle timeout in ms, unless the default transport profile "
+              "sets idle_timeout_ms");
 DEFINE_string(local_address, "", "Local Address to bind to. Client only. Format should be ip:port");
 DEFINE_string(mode, "server", "Mode to run in: 'client' or 'server'");
 DEFINE_string(body, "", "Filename to read from for POST requests");
@@ -64,6 +125,10 @@ DEFINE_uint32(quic_batching_mode,
 DEFINE_uint32(quic_batch_size,
               quic::kDefaultQuicMaxBatchSize,
               "Maximum number of packets that can be batched in Quic");
+DEFINE_bool(quic_batching_autotune,
+            false,
+            "Measure UDP send batching on loopback at startup and use the fastest mode and "
+            "batch size instead of quic_batching_mode and quic_batch_size");
 DEFINE_string(cert, "resources/test.pem", "Certificate file path");
 DEFINE_string(key, "resources/test-key.pem", "Private key file path");
 DEFINE_string(client_auth_mode, "none", "Client authentication mode");
@@ -78,6 +143,43 @@ DEFINE_bool(migrate_client,
             false,
             "(HQClient) Should the HQClient make two sets of requests and "
             "switch sockets in the middle.");
+DEFINE_uint32(devious_baton_sessions,
+              0,
+              "(HQClient) Run this many concurrent devious-baton WebTransport sessions "
+              "instead of fetching <path>, one QUIC connection each");
+DEFINE_uint32(devious_baton_threads, 1, "(HQClient) Event loop threads for devious-baton sessions");
+DEFINE_uint32(devious_baton_count, 1, "(HQClient) Parallel batons per devious-baton session");
+DEFINE_uint32(devious_baton_initial,
+              1,
+              "(HQClient) Starting baton value, each baton makes 256 - value hops");
+DEFINE_uint32(devious_baton_timeout_ms,
+              60000,
+              "(HQClient) Fail a devious-baton session that has not finished after this "
+              "many ms, 0 waits forever");
+DEFINE_uint32(baton_bench_iterations,
+              0,
+              "(HQClient) Run the in-process baton message microbenchmark with this many "
+              "iterations per case instead of fetching <path>");
+DEFINE_uint32(handshake_bench_connections,
+              0,
+              "(HQClient) Benchmark this many handshakes per handshake type instead of "
+              "fetching <path>, closing each connection once the handshake completes");
+DEFINE_uint32(handshake_bench_threads,
+              1,
+              "(HQClient) Event loop threads for the handshake benchmark");
+DEFINE_uint32(handshake_bench_concurrency,
+              16,
+              "(HQClient) Handshakes in flight per handshake benchmark thread");
+DEFINE_string(handshake_bench_types,
+              "full,resumed,0rtt",
+              "(HQClient) Comma separated handshake types to benchmark: full, resumed, 0rtt");
+DEFINE_string(handshake_bench_output,
+              "",
+              "(HQClient) File to write the handshake benchmark results to as JSON");
+DEFINE_bool(handshake_bench_local,
+            false,
+            "(HQClient) Benchmark a server started in-process on loopback, with --threads "
+            "workers, instead of --host:--port");
 DEFINE_bool(use_inplace_write, false, "Transport use inplace packet build and socket writing");
 
 DEFINE_bool(send_knob_frame,
@@ -121,6 +223,18 @@ DEFINE_bool(writer_backpressure,
 DEFINE_bool(use_l4s_ecn, false, "Whether to use L4S for ECN marking");
 DEFINE_bool(read_ecn, false, "Whether to read and echo ecn marking from ingress packets");
 DEFINE_uint32(dscp, 0, "DSCP value to use for outgoing packets");
+DEFINE_uint64(echo_max_inflight_bytes,
+              256 * 1024,
+              "Echoed body bytes per transaction not yet acknowledged by the peer at which "
+              "the echo handler pauses ingress, 0 = unlimited");
+DEFINE_uint32(datagram_batch_max_queued,
+              1024,
+              "Datagrams the WebTransport echo queues per session and event loop iteration, "
+              "0 = echo each datagram immediately");
+DEFINE_uint64(push_max_bytes,
+              16 * 1024 * 1024,
+              "Largest pushed body the server builds, larger sizes requested in the push "
+              "path are clamped to it");
 
 namespace quic::samples
 {
@@ -144,6 +258,33 @@ namespace quic::samples
         return outStream;
     }
 
+    // Parses "0,2,4-7" style CPU lists
+    bool parseCpuList(const std::string& cpuList, std::vector<int>& cpus)
+    {
+        std::vector<folly::StringPiece> ranges;
+        folly::split(',', cpuList, ranges, true);
+        for (auto range : ranges)
+        {
+            folly::StringPiece first;
+            folly::StringPiece last;
+            if (!folly::split('-', range, first, last))
+            {
+                first = last = range;
+            }
+            auto from = folly::tryTo<int>(first);
+            auto to   = folly::tryTo<int>(last);
+            if (!from || !to || *from < 0 || *from > *to || *to >= CPU_SETSIZE)
+            {
+                return false;
+            }
+            for (auto cpu = *from; cpu <= *to; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return true;
+    }
+
     void initializeCommonSettings(HQToolParams& hqParams);
     void initializeTransportSettings(HQToolParams& hqParams);
 
@@ -229,6 +370,22 @@ namespace quic::samples
             serverParams.httpServerThreads = FLAGS_threads;
             serverParams.localAddress =
                 folly::SocketAddress(serverParams.host, serverParams.port, true);
+            parseCpuList(FLAGS_worker_cpus, serverParams.workerCpus);
+            serverParams.workerStatsInterval = std::chrono::seconds(FLAGS_worker_stats_interval_s);
+            serverParams.unifiedEventLoops   = FLAGS_unified_event_loops;
+            serverParams.takeoverSocketPath  = FLAGS_takeover_socket;
+            serverParams.takeoverForwardPort = FLAGS_takeover_forward_port;
+            serverParams.takeoverDrainPeriod = std::chrono::seconds(FLAGS_takeover_drain_s);
+            serverParams.loopLagThresholds   = {
+                .retry  = std::chrono::milliseconds(FLAGS_loop_lag_retry_ms),
+                .reject = std::chrono::milliseconds(FLAGS_loop_lag_reject_ms),
+                .shed   = std::chrono::milliseconds(FLAGS_loop_lag_shed_ms),
+            };
+            serverParams.ticketKeyFile           = FLAGS_ticket_key_file;
+            serverParams.ticketKeyReloadInterval = std::chrono::seconds(FLAGS_ticket_key_reload_s);
+            serverParams.replayCacheCapacity     = FLAGS_replay_cache_entries;
+            serverParams.signThreads             = FLAGS_sign_threads;
+            serverParams.transportProfilesFile   = FLAGS_transport_profiles;
         }
         else if (FLAGS_mode == "client")
         {
@@ -319,7 +476,9 @@ namespace quic::samples
         {
             baseParams.transportSettings.dataPathType = quic::DataPathType::ContinuousMemory;
         }
-        if (FLAGS_rate_limit >= 0)
+        // validate() rejects the loop lag flags in client mode
+        if (FLAGS_rate_limit >= 0 ||
+            (hqParams.mode == HQMode::SERVER && FLAGS_loop_lag_retry_ms > 0))
         {
             CHECK(hqParams.mode == HQMode::SERVER);
             std::array<uint8_t, kRetryTokenSecretLength> secret;
@@ -342,6 +501,10 @@ namespace quic::samples
         baseParams.transportSettings.shouldUseRecvmmsgForBatchRecv   = true;
         baseParams.transportSettings.advertisedInitialMaxStreamsBidi = 100;
         baseParams.transportSettings.advertisedInitialMaxStreamsUni  = 100;
+        if (FLAGS_quic_batching_autotune)
+        {
+            calibrateUdpBatching(baseParams.transportSettings);
+        }
 
         if (FLAGS_use_ack_receive_timestamps)
         {
@@ -382,12 +545,15 @@ namespace quic::samples
         hqParams.h2port                = FLAGS_h2port;
         hqParams.localH2Address        = folly::SocketAddress(hqParams.host, hqParams.h2port, true);
         hqParams.httpServerThreads     = FLAGS_threads;
-        hqParams.httpServerIdleTimeout = std::chrono::milliseconds(60000);
+        hqParams.httpServerIdleTimeout = std::chrono::milliseconds(FLAGS_h2_idle_timeout_ms);
         hqParams.httpServerShutdownOn  = {SIGINT, SIGTERM};
         hqParams.httpServerEnableContentCompression = false;
         hqParams.h2cEnabled                         = false;
         hqParams.httpVersion.parse(FLAGS_httpversion);
-        hqParams.txnTimeout = std::chrono::milliseconds(FLAGS_txn_timeout);
+        hqParams.txnTimeout             = std::chrono::milliseconds(FLAGS_txn_timeout);
+        hqParams.echoMaxInflightBytes   = FLAGS_echo_max_inflight_bytes;
+        hqParams.datagramBatchMaxQueued = FLAGS_datagram_batch_max_queued;
+        hqParams.pushMaxBytes           = FLAGS_push_max_bytes;
     }  // initializeHttpServerSettings
 
     void initializeHttpClientSettings(HQToolClientParams& hqParams)
@@ -431,6 +597,22 @@ namespace quic::samples
         hqParams.migrateClient = FLAGS_migrate_client;
         hqParams.txnTimeout    = std::chrono::milliseconds(FLAGS_txn_timeout);
         hqParams.httpVersion.parse(FLAGS_httpversion);
+
+        hqParams.batonSessions = FLAGS_devious_baton_sessions;
+        hqParams.batonThreads  = FLAGS_devious_baton_threads;
+        hqParams.batonCount    = FLAGS_devious_baton_count;
+        hqParams.batonInitial  = static_cast<uint8_t>(FLAGS_devious_baton_initial);
+        hqParams.batonTimeout  = std::chrono::milliseconds(FLAGS_devious_baton_timeout_ms);
+
+        hqParams.batonBenchIterations = FLAGS_baton_bench_iterations;
+
+        hqParams.handshakeBenchConnections   = FLAGS_handshake_bench_connections;
+        hqParams.handshakeBenchThreads       = FLAGS_handshake_bench_threads;
+        hqParams.handshakeBenchConcurrency   = FLAGS_handshake_bench_concurrency;
+        hqParams.handshakeBenchOutput        = FLAGS_handshake_bench_output;
+        hqParams.handshakeBenchLocal         = FLAGS_handshake_bench_local;
+        hqParams.handshakeBenchServerThreads = FLAGS_threads;
+        folly::split(',', FLAGS_handshake_bench_types, hqParams.handshakeBenchTypes, true);
     }  // initializeHttpClientSettings
 
     void initializeQLogSettings(MyHQBaseParams& hqParams)
@@ -502,6 +684,104 @@ namespace quic::samples
             {
                 INVALID_PARAM(port, "HQClient expected --port");
             }
+            if (clientParams.batonSessions > 0)
+            {
+                if (FLAGS_devious_baton_initial == 0 || FLAGS_devious_baton_initial > 255)
+                {
+                    INVALID_PARAM(devious_baton_initial, "expected a baton in [1, 255]");
+                }
+                if (clientParams.batonCount == 0 || clientParams.batonCount > 10)
+                {
+                    INVALID_PARAM(devious_baton_count, "expected between 1 and 10 batons");
+                }
+            }
+            if (clientParams.handshakeBenchConnections > 0)
+            {
+                if (clientParams.handshakeBenchConcurrency == 0)
+                {
+                    INVALID_PARAM(handshake_bench_concurrency, "expected at least 1");
+                }
+                for (const auto& type : clientParams.handshakeBenchTypes)
+                {
+                    if (type != "full" && type != "resumed" && type != "0rtt")
+                    {
+                        INVALID_PARAM(handshake_bench_types,
+                                      "expected a list of full, resumed and 0rtt");
+                        break;
+                    }
+                }
+            }
+            else if (clientParams.handshakeBenchLocal || !clientParams.handshakeBenchOutput.empty())
+            {
+                INVALID_PARAM(handshake_bench_connections,
+                              "expected at least 1 with the other handshake_bench flags");
+            }
+        }
+
+        std::vector<int> workerCpus;
+        if (params.mode == HQMode::SERVER && !parseCpuList(FLAGS_worker_cpus, workerCpus))
+        {
+            INVALID_PARAM(worker_cpus, "expected a comma separated list of CPUs or ranges");
+        }
+
+        if (FLAGS_takeover_forward_port == 0 || FLAGS_takeover_forward_port >= 65535)
+        {
+            INVALID_PARAM(takeover_forward_port, "expected a port in [1, 65534]");
+        }
+
+        std::vector<std::string> ticketSecrets;
+        if (params.mode == HQMode::SERVER && !FLAGS_ticket_key_file.empty() &&
+            !readTicketSecrets(FLAGS_ticket_key_file, ticketSecrets))
+        {
+            INVALID_PARAM(ticket_key_file, "expected one hex encoded secret per line");
+        }
+
+        TransportProfileSet transportProfiles;
+        if (params.mode == HQMode::SERVER && !FLAGS_transport_profiles.empty() &&
+            !readTransportProfiles(FLAGS_transport_profiles, transportProfiles))
+        {
+            INVALID_PARAM(transport_profiles, "expected a JSON object of profiles, see the log");
+        }
+
+        // Each overload stage implies the ones before it, so an enabled stage may not start
+        // below an earlier one
+        if (params.mode == HQMode::SERVER)
+        {
+            const auto& lag = boost::get<HQToolServerParams>(params.params).loopLagThresholds;
+            if (lag.reject.count() > 0 && lag.retry > lag.reject)
+            {
+                INVALID_PARAM(loop_lag_retry_ms, "expected at most --loop_lag_reject_ms");
+            }
+            if (lag.shed.count() > 0 && lag.retry > lag.shed)
+            {
+                INVALID_PARAM(loop_lag_retry_ms, "expected at most --loop_lag_shed_ms");
+            }
+            if (lag.shed.count() > 0 && lag.reject > lag.shed)
+            {
+                INVALID_PARAM(loop_lag_reject_ms, "expected at most --loop_lag_shed_ms");
+            }
+        }
+        else
+        {
+            if (FLAGS_loop_lag_retry_ms > 0)
+            {
+                INVALID_PARAM(loop_lag_retry_ms, "only supported in server mode");
+            }
+            if (FLAGS_loop_lag_reject_ms > 0)
+            {
+                INVALID_PARAM(loop_lag_reject_ms, "only supported in server mode");
+            }
+            if (FLAGS_loop_lag_shed_ms > 0)
+            {
+                INVALID_PARAM(loop_lag_shed_ms, "only supported in server mode");
+            }
+        }
+
+        if (FLAGS_replay_cache_entries < 2 * BoundedReplayCache::kShards)
+        {
+            INVALID_PARAM(replay_cache_entries,
+                          folly::to<std::string>("expected at least ",
+                                                 2 * BoundedReplayCache::kShards));
         }
 
         // Validate the transport section
@@ -32,6 +32,23 @@ namespace quic::samples
         bool migrateClient = false;
         bool sendRequestsSequentially;
         std::vector<std::string> requestGaps;
+        // Devious-baton load mode, enabled when batonSessions > 0
+        uint32_t batonSessions = 0;
+        uint32_t batonThreads  = 1;
+        uint32_t batonCount    = 1;
+        uint8_t batonInitial   = 1;
+        std::chrono::milliseconds batonTimeout {60000};
+        // Baton message microbenchmark, enabled when batonBenchIterations > 0
+        uint32_t batonBenchIterations = 0;
+        // Handshake benchmark, enabled when handshakeBenchConnections > 0
+        uint32_t handshakeBenchConnections = 0;
+        uint32_t handshakeBenchThreads     = 1;
+        uint32_t handshakeBenchConcurrency = 1;
+        std::vector<std::string> handshakeBenchTypes;
+        std::string handshakeBenchOutput;
+        // Benchmark an in-process server on loopback instead of remoteAddress
+        bool handshakeBenchLocal           = false;
+        size_t handshakeBenchServerThreads = 1;
     };
 
     struct HQToolServerParams : public MyHQServerParams
@@ -43,6 +60,12 @@ namespace quic::samples
         std::vector<int> httpServerShutdownOn;
         bool httpServerEnableContentCompression;
         bool h2cEnabled;
+        uint64_t echoMaxInflightBytes = 0;
+        uint32_t datagramBatchMaxQueued = 0;
+        uint64_t pushMaxBytes = 0;
+        std::chrono::seconds workerStatsInterval {0};
+        // H2 acceptors share the QUIC worker event loops
+        bool unifiedEventLoops = false;
     };
 
     struct HQToolParams
@@ -15,6 +15,8 @@
 #include <quic/fizz/client/handshake/QuicPskCache.h>
 #include <quic/state/TransportSettings.h>
 
+#include "LoopLagMonitor.h"
+
 namespace quic::samples
 {
     struct MyHTTPVersion
@@ -87,6 +89,27 @@ namespace quic::samples
         size_t serverThreads = 0;
         std::string ccpConfig;
         folly::Optional<int64_t> rateLimitPerThread;
+        // Worker i is pinned to workerCpus[i]; empty leaves placement to the OS
+        std::vector<int> workerCpus;
+        // Unix socket to take over the UDP sockets of a running server from, and to
+        // hand them to the next one; empty disables takeover
+        std::string takeoverSocketPath;
+        // Loopback port a draining server receives forwarded packets on; process id ONE
+        // uses the next port so that both generations can drain at the same time
+        uint16_t takeoverForwardPort = 0;
+        std::chrono::milliseconds takeoverDrainPeriod {0};
+        LoopLagThresholds loopLagThresholds;
+        // Session ticket secrets shared by all server processes; empty uses random
+        // secrets. Reloaded every ticketKeyReloadInterval when non-zero
+        std::string ticketKeyFile;
+        std::chrono::seconds ticketKeyReloadInterval {0};
+        // Identifiers the 0-RTT replay cache holds before it evicts early
+        size_t replayCacheCapacity = 1 << 20;
+        // Threads signing handshakes off the QUIC workers, 0 signs on the workers
+        uint32_t signThreads = 0;
+        // JSON file of transport profiles, see readTransportProfiles(); reloaded on
+        // SIGHUP. Empty uses transportSettings for every connection
+        std::string transportProfilesFile;
     };
 
     struct MyHQInvalidParam
@@ -1,9 +1,19 @@
 #include "HQServer.h"
 
 #include <quic/common/udpsocket/FollyQuicAsyncUDPSocket.h>
+#include <algorithm>
+#include <csignal>
+#include <limits>
 #include <ostream>
 #include <string>
 
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <folly/io/async/EventBaseLocal.h>
 #include <proxygen/lib/http/session/HQDownstreamSession.h>
 #include <quic/server/QuicSharedUDPSocketFactory.h>
@@ -11,6 +21,10 @@
 #include "FizzContext.h"
 #include "H1QDownstreamSession.h"
 #include "HQLoggerHelper.h"
+#include "LoopLagMonitor.h"
+#include "LoopStats.h"
+#include "Tracepoints.h"
+#include "WorkerTransportStats.h"
 
 using fizz::server::FizzServerContext;
 using quic::QuicServerTransport;
@@ -20,6 +34,28 @@ namespace
     using namespace quic::samples;
     using namespace proxygen;
 
+    bool pinCurrentThread(int cpu)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+    }
+
+    // Allocations of the calling thread go to the NUMA node it runs on, even when the
+    // process was started with an interleave or bind policy
+    bool setLocalMemoryPolicy()
+    {
+        return syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == 0;
+    }
+
+    // Makes the kernel prefer this socket of the reuseport group for packets whose
+    // softirq runs on the given CPU
+    bool steerSocketToCpu(int fd, int cpu)
+    {
+        return setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+    }
+
     /**
      * HQSessionController creates new HQSession objects
      *
@@ -141,6 +177,7 @@ namespace quic::samples
         HQServer(
             std::move(hqParams),
             std::make_unique<HQServerTransportFactory>(params,
+                                                       transportProfiles,
                                                        std::move(httpTransactionHandlerProvider),
                                                        std::move(onTransportReadyFn)))
     {
@@ -160,8 +197,33 @@ namespace quic::samples
         server->setQuicServerTransportFactory(std::move(factory));
         server->setQuicUDPSocketFactory(std::make_unique<QuicSharedUDPSocketFactory>());
         server->setHealthCheckToken("health");
+        if (!params.workerCpus.empty() || !params.takeoverSocketPath.empty())
+        {
+            // Socket steering and takeover need one socket per worker
+            server->setReusePortEnabled(true);
+        }
         server->setSupportedVersion(params.quicVersions);
-        server->setFizzContext(createFizzServerContext(params));
+        ticketCipher = std::make_shared<RotatingTicketCipher>();
+        server->setFizzContext(createFizzServerContext(params, ticketCipher));
+        installOverloadHooks();
+
+        if (!params.transportProfilesFile.empty())
+        {
+            if (!transportProfiles.load(params.transportProfilesFile, params.transportSettings))
+            {
+                LOG(FATAL) << "Invalid transport profiles in " << params.transportProfilesFile;
+            }
+            updateWorkerSettings();
+            // Runs on the worker accepting the connection, before its transport
+            // parameters are encoded
+            server->setTransportSettingsOverrideFn(
+                [this](const quic::TransportSettings& settings, const folly::IPAddress&)
+                {
+                    auto overridden = settings;
+                    transportProfiles.applyDefault(overridden);
+                    return overridden;
+                });
+        }
 
         if (params.rateLimitPerThread)
         {
@@ -174,7 +236,7 @@ namespace quic::samples
         }
     }
 
-    void HQServer::start()
+    folly::SocketAddress HQServer::getBindAddress() const
     {
         folly::SocketAddress localAddress;
         if (params.localAddress)
@@ -185,7 +247,245 @@ namespace quic::samples
         {
             localAddress.setFromLocalPort(params.port);
         }
-        server->start(localAddress, params.serverThreads);
+        return localAddress;
+    }
+
+    void HQServer::start()
+    {
+        auto takeover = acquireSockets();
+        if (params.workerCpus.empty())
+        {
+            server->start(getBindAddress(), params.serverThreads);
+        }
+        else
+        {
+            server->start(getBindAddress(), params.workerCpus.size());
+            server->waitUntilInitialized();
+            pinWorkers();
+        }
+        instrumentWorkers();
+        completeTakeover(std::move(takeover));
+    }
+
+    void HQServer::start(const std::shared_ptr<folly::IOThreadPoolExecutor>& ioExecutor)
+    {
+        std::vector<folly::EventBase*> eventBases;
+        for (auto& eventBase : ioExecutor->getAllEventBases())
+        {
+            eventBases.push_back(eventBase.get());
+        }
+        auto takeover = acquireSockets();
+        // Same worker setup QuicServer::start() does on the loops it owns
+        server->initialize(getBindAddress(), eventBases, true /* useDefaultTransport */);
+        server->start();
+        if (!params.workerCpus.empty())
+        {
+            server->waitUntilInitialized();
+            pinWorkers();
+        }
+        instrumentWorkers();
+        completeTakeover(std::move(takeover));
+    }
+
+    void HQServer::installOverloadHooks()
+    {
+        const auto& thresholds = params.loopLagThresholds;
+        if (thresholds.retry.count() > 0)
+        {
+            // Both hooks run on the worker that handles the new connection, so they see
+            // the lag of that worker
+            server->setUnfinishedHandshakeLimit(
+                []
+                {
+                    return LoopLagMonitor::getCurrentLevel() >= OverloadLevel::RETRY
+                               ? 0
+                               : std::numeric_limits<int>::max();
+                });
+        }
+        if (thresholds.reject.count() > 0)
+        {
+            server->rejectNewConnections(
+                []
+                {
+                    return LoopLagMonitor::getCurrentLevel() >= OverloadLevel::REJECT;
+                });
+        }
+    }
+
+    void HQServer::instrumentWorkers()
+    {
+        server->waitUntilInitialized();
+        for (auto eventBase : server->getWorkerEvbs())
+        {
+            eventBase->runInEventBaseThreadAndWait(
+                [eventBase, thresholds = params.loopLagThresholds]
+                {
+                    LoopStats::install(eventBase);
+                    if (thresholds.enabled())
+                    {
+                        LoopLagMonitor::start(eventBase, thresholds);
+                    }
+                });
+        }
+    }
+
+    folly::Optional<TakeoverClient> HQServer::acquireSockets()
+    {
+        if (params.takeoverSocketPath.empty())
+        {
+            return folly::none;
+        }
+        auto takeover = TakeoverClient::connect(params.takeoverSocketPath);
+        if (!takeover)
+        {
+            LOG(INFO) << "No server to take over at " << params.takeoverSocketPath;
+            return folly::none;
+        }
+        const auto& state = takeover->getState();
+        // Connection ids carry the process id, which is how the workers tell the old
+        // server's packets from their own
+        processId = state.processId == quic::ProcessId::ZERO ? quic::ProcessId::ONE
+                                                             : quic::ProcessId::ZERO;
+        server->setProcessId(processId);
+        server->setListeningFDs(state.udpFds);
+        LOG(INFO) << "Taking over " << state.udpFds.size() << " UDP sockets, forwarding to "
+                  << state.forwardAddress.describe();
+        return takeover;
+    }
+
+    void HQServer::completeTakeover(folly::Optional<TakeoverClient> takeover)
+    {
+        if (params.takeoverSocketPath.empty())
+        {
+            return;
+        }
+        server->waitUntilInitialized();
+        if (takeover)
+        {
+            server->startPacketForwarding(takeover->getState().forwardAddress);
+            takeover->complete();
+            // The old server exits once its drain period is over
+            server->stopPacketForwarding(params.takeoverDrainPeriod);
+        }
+
+        folly::SocketAddress forwardAddress(
+            "127.0.0.1",
+            params.takeoverForwardPort + (processId == quic::ProcessId::ONE ? 1 : 0));
+        server->allowBeingTakenOver(forwardAddress);
+        takeoverListener = std::make_unique<TakeoverListener>(
+            params.takeoverSocketPath,
+            [this, forwardAddress]
+            {
+                return TakeoverState {
+                    .udpFds         = server->getAllListeningSocketFDs(),
+                    .processId      = processId,
+                    .forwardAddress = forwardAddress,
+                };
+            },
+            [this]
+            {
+                onTakenOver();
+            });
+    }
+
+    void HQServer::onTakenOver()
+    {
+        // Packets of new connections now reach the successor only; ours come back
+        // through the forwarding socket
+        server->pauseRead();
+        auto eventBase = server->getWorkerEvbs().front();
+        eventBase->runInEventBaseThread(
+            [eventBase, drainPeriod = params.takeoverDrainPeriod]
+            {
+                eventBase->timer().scheduleTimeoutFn(
+                    []
+                    {
+                        LOG(INFO) << "Takeover drain period over, shutting down";
+                        raise(SIGTERM);
+                    },
+                    drainPeriod);
+            });
+    }
+
+    void HQServer::pinWorkers()
+    {
+        auto eventBases = server->getWorkerEvbs();
+        auto socketFds  = server->getAllListeningSocketFDs();
+        for (size_t i = 0; i < eventBases.size(); ++i)
+        {
+            auto cpu = params.workerCpus[i % params.workerCpus.size()];
+            eventBases[i]->runInEventBaseThreadAndWait(
+                [i, cpu]
+                {
+                    if (!pinCurrentThread(cpu))
+                    {
+                        PLOG(ERROR) << "Failed to pin QUIC worker " << i << " to CPU " << cpu;
+                    }
+                    if (!setLocalMemoryPolicy())
+                    {
+                        PLOG(WARNING) << "Failed to set local memory policy on worker " << i;
+                    }
+                });
+            if (i < socketFds.size() && !steerSocketToCpu(socketFds[i], cpu))
+            {
+                PLOG(ERROR) << "Failed to set SO_INCOMING_CPU on worker " << i << " socket";
+            }
+            LOG(INFO) << "QUIC worker " << i << " pinned to CPU " << cpu;
+        }
+    }
+
+    void HQServer::logWorkerStats() const
+    {
+        auto eventBases = server->getWorkerEvbs();
+        auto snapshots  = WorkerTransportStats::getSnapshots();
+        for (size_t i = 0; i < eventBases.size(); ++i)
+        {
+            auto snapshot = std::find_if(snapshots.begin(),
+                                         snapshots.end(),
+                                         [evb = eventBases[i]](const auto& candidate)
+                                         {
+                                             return candidate.eventBase == evb;
+                                         });
+            if (snapshot == snapshots.end())
+            {
+                continue;
+            }
+            LOG(INFO) << "QUIC worker " << i << ": packets received=" << snapshot->packetsReceived
+                      << " sent=" << snapshot->packetsSent
+                      << " dropped=" << snapshot->packetsDropped
+                      << " connections=" << snapshot->newConnections;
+        }
+    }
+
+    void HQServer::reloadTicketSecrets()
+    {
+        if (!params.ticketKeyFile.empty() && !loadTicketSecrets(params, *ticketCipher))
+        {
+            LOG(ERROR) << "Keeping the current ticket secrets";
+        }
+    }
+
+    void HQServer::reloadTransportProfiles()
+    {
+        if (params.transportProfilesFile.empty())
+        {
+            return;
+        }
+        if (!transportProfiles.load(params.transportProfilesFile, params.transportSettings))
+        {
+            LOG(ERROR) << "Keeping the current transport profiles";
+            return;
+        }
+        updateWorkerSettings();
+    }
+
+    void HQServer::updateWorkerSettings()
+    {
+        // Starts from the command line settings, so a reload that drops a field restores
+        // them; QuicServer forwards the settings to every running worker
+        auto settings = params.transportSettings;
+        transportProfiles.applyDefault(settings);
+        server->setTransportSettings(std::move(settings));
     }
 
     const folly::SocketAddress HQServer::getAddress() const
@@ -198,6 +498,7 @@ namespace quic::samples
 
     void HQServer::stop()
     {
+        takeoverListener.reset();
         server->shutdown();
     }
 
@@ -212,9 +513,11 @@ namespace quic::samples
 
     HQServerTransportFactory::HQServerTransportFactory(
         const MyHQServerParams& hqParams,
+        const TransportProfiles& profiles,
         HTTPTransactionHandlerProvider provider,
         std::function<void(proxygen::HQSession*)> onTransportReadyFunction) :
-        params(hqParams), httpTransactionHandlerProvider(std::move(provider)),
+        params(hqParams), transportProfiles(profiles),
+        httpTransactionHandlerProvider(std::move(provider)),
         onTransportReadyFn(std::move(onTransportReadyFunction))
     {
         alpnHandlers[kHQ] = [this](std::shared_ptr<quic::QuicSocket> quicSocket,
@@ -258,6 +561,13 @@ namespace quic::samples
         {
             iter = alpnHandlers.find(*alpn);
         }
+        VLOG(4) << "onQuicTransportReady! alpn=" << alpn.value_or("");
+        if (alpn)
+        {
+            transportProfiles.applyAlpn(*alpn, *quicSocket);
+        }
+        SAMPLE_TRACE(transport_ready, iter != alpnHandlers.end());
+
         auto quicEventBase          = quicSocket->getEventBase();
         folly::EventBase* eventBase = nullptr;
         if (quicEventBase)
@@ -275,7 +585,6 @@ namespace quic::samples
         {
             iter->second(std::move(quicSocket), getConnectionManager(eventBase));
         }
-        LOG(INFO) << "onQuicTransportReady!";
     }
 
     void HQServerTransportFactory::onConnectionSetupError(
@@ -3,12 +3,16 @@
 #include <iostream>
 #include <string>
 
+#include <folly/executors/IOThreadPoolExecutor.h>
 #include <folly/io/async/EventBaseLocal.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 #include <quic/server/QuicHandshakeSocketHolder.h>
 #include <quic/server/QuicServer.h>
 
 #include "HQParams.h"
+#include "Takeover.h"
+#include "TicketCipher.h"
+#include "TransportProfiles.h"
 
 namespace proxygen
 {
@@ -33,6 +37,10 @@ namespace quic::samples
         // Starts the QUIC transport in background thread
         void start();
 
+        // Starts the QUIC workers on the event loops of ioExecutor, one per thread, so
+        // they can be shared with other servers. ioExecutor must outlive stop().
+        void start(const std::shared_ptr<folly::IOThreadPoolExecutor>& ioExecutor);
+
         // Returns the listening address of the server
         // NOTE: can block until the server has started
         const folly::SocketAddress getAddress() const;
@@ -48,6 +56,21 @@ namespace quic::samples
         // Sets/unsets "reject connections" flag on the QUIC server
         void rejectNewConnections(bool reject);
 
+        // Logs per-worker packet counters, requires WorkerTransportStatsFactory
+        void logWorkerStats() const;
+
+        // Reloads params.ticketKeyFile, keeping the current secrets if it is invalid
+        void reloadTicketSecrets();
+
+        // Reloads params.transportProfilesFile for new connections, keeping the current
+        // profiles if it is invalid
+        void reloadTransportProfiles();
+
+        [[nodiscard]] const TransportProfiles& getTransportProfiles() const
+        {
+            return transportProfiles;
+        }
+
         void setStatsFactory(
             std::unique_ptr<quic::QuicTransportStatsCallbackFactory>&& statsFactory)
         {
@@ -56,8 +79,38 @@ namespace quic::samples
         }
 
     private:
+        folly::SocketAddress getBindAddress() const;
+
+        // Hooks new connection admission to the worker loop lag, see LoopLagMonitor
+        void installOverloadHooks();
+
+        // Hands the default transport profile to the workers, which read some settings,
+        // e.g. maxRecvBatchSize, from their own copy rather than the connection's
+        void updateWorkerSettings();
+
+        // Installs LoopStats and, if configured, LoopLagMonitor on every worker
+        void instrumentWorkers();
+
+        // Adopts the sockets of the server at params.takeoverSocketPath, if any
+        folly::Optional<TakeoverClient> acquireSockets();
+
+        // Forwards the old server's packets back to it, lets it drain and then listens
+        // for the next takeover
+        void completeTakeover(folly::Optional<TakeoverClient> takeover);
+
+        // Called on the listener thread once a successor serves the sockets
+        void onTakenOver();
+
+        // Pins every worker thread and its listening socket to params.workerCpus
+        void pinWorkers();
+
         MyHQServerParams params;
+        // Used by the transport factory and the workers, so it outlives server
+        TransportProfiles transportProfiles;
         std::shared_ptr<quic::QuicServer> server;
+        quic::ProcessId processId = quic::ProcessId::ZERO;
+        std::unique_ptr<TakeoverListener> takeoverListener;
+        std::shared_ptr<RotatingTicketCipher> ticketCipher;
     };
 
     class ScopedHQServer
@@ -96,6 +149,7 @@ namespace quic::samples
     public:
         explicit HQServerTransportFactory(
             const MyHQServerParams& params,
+            const TransportProfiles& transportProfiles,
             HTTPTransactionHandlerProvider httpTransactionHandlerProvider,
             std::function<void(proxygen::HQSession*)> onTransportReadyFunction);
 
@@ -133,6 +187,7 @@ namespace quic::samples
 
         // Configuration params
         const MyHQServerParams& params;
+        const TransportProfiles& transportProfiles;
         // Provider of HTTPTransactionHandler
         HTTPTransactionHandlerProvider httpTransactionHandlerProvider;
         std::function<void(proxygen::HQSession*)> onTransportReadyFn;
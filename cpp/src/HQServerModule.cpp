@@ -1,8 +1,20 @@
 #include "HQServerModule.h"
+#include <fizz/record/Types.h>
+#include <folly/executors/IOThreadPoolExecutor.h>
+#include <folly/executors/thread_factory/NamedThreadFactory.h>
+#include <folly/experimental/FunctionScheduler.h>
+#include <folly/io/async/AsyncSignalHandler.h>
 #include <proxygen/lib/http/session/HQSession.h>
+#include "CertCompression.h"
 #include "H2Server.h"
 #include "HQServer.h"
+#include "LoopStats.h"
+#include "ReplayCache.h"
 #include "SampleHandler.h"
+#include "SignOffload.h"
+#include "WorkerTransportStats.h"
+
+#include <algorithm>
 
 using namespace proxygen;
 
@@ -27,6 +39,78 @@ namespace
             LOG(ERROR) << "Failed to send Knob frame to peer. Received error: " << knobSent.error();
         }
     }
+
+    /**
+     * Handles every signal of the server: the shutdown signals stop the loop, SIGUSR2
+     * logs per-worker loop utilisation and SIGHUP reloads the transport profiles.
+     *
+     * libevent delivers signals to only one event_base per process, the one that
+     * registered last, so all of them are registered here on one EventBase and nothing
+     * else in the process may register signals.
+     */
+    class ServerSignalHandler : public folly::AsyncSignalHandler
+    {
+    public:
+        ServerSignalHandler(folly::EventBase* evb,
+                            const quic::samples::HQToolServerParams& params,
+                            quic::samples::HQServer& hqServer) :
+            folly::AsyncSignalHandler(evb), shutdownOn(params.httpServerShutdownOn),
+            server(hqServer)
+        {
+            for (auto signum : shutdownOn)
+            {
+                registerSignalHandler(signum);
+            }
+            if (!isShutdownSignal(SIGUSR2))
+            {
+                registerSignalHandler(SIGUSR2);
+            }
+            if (!params.transportProfilesFile.empty() && !isShutdownSignal(SIGHUP))
+            {
+                registerSignalHandler(SIGHUP);
+            }
+        }
+
+        void signalReceived(int signum) noexcept override
+        {
+            if (isShutdownSignal(signum))
+            {
+                LOG(INFO) << "Received signal " << signum << ", shutting down";
+                getEventBase()->terminateLoopSoon();
+            }
+            else if (signum == SIGUSR2)
+            {
+                quic::samples::LoopStats::dump();
+            }
+            else if (signum == SIGHUP)
+            {
+                LOG(INFO) << "Received SIGHUP, reloading transport profiles";
+                server.reloadTransportProfiles();
+            }
+        }
+
+    private:
+        [[nodiscard]] bool isShutdownSignal(int signum) const
+        {
+            return std::find(shutdownOn.begin(), shutdownOn.end(), signum) != shutdownOn.end();
+        }
+
+        std::vector<int> shutdownOn;
+        quic::samples::HQServer& server;
+    };
+
+    size_t getUnifiedLoopCount(const quic::samples::HQToolServerParams& params)
+    {
+        if (!params.workerCpus.empty())
+        {
+            return params.workerCpus.size();
+        }
+        if (params.httpServerThreads > 0)
+        {
+            return params.httpServerThreads;
+        }
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
 }  // namespace
 
 namespace quic::samples
@@ -34,14 +118,15 @@ namespace quic::samples
     void startServer(const HQToolServerParams& params,
                      std::unique_ptr<quic::QuicTransportStatsCallbackFactory>&& statsFactory)
     {
-        // Run H2 server in a separate thread
-        Dispatcher dispatcher(
-            HandlerParams(params.protocol, params.port, params.httpVersion.canonical));
+        HandlerParams handlerParams(params.protocol, params.port, params.httpVersion.canonical);
+        handlerParams.echoMaxInflightBytes   = params.echoMaxInflightBytes;
+        handlerParams.datagramBatchMaxQueued = params.datagramBatchMaxQueued;
+        handlerParams.pushMaxBytes           = params.pushMaxBytes;
+        Dispatcher dispatcher(std::move(handlerParams));
         auto dispatchFn = [&dispatcher](proxygen::HTTPMessage* request)
         {
             return dispatcher.getRequestHandler(request);
         };
-        auto h2server = H2Server::run(params, dispatchFn);
 
         // Run HQ Server
         std::function<void(HQSession*)> onTransportReadyFn;
@@ -53,15 +138,105 @@ namespace quic::samples
             };
         }
         HQServer server(params, dispatchFn, std::move(onTransportReadyFn));
-        if (statsFactory)
+        server.setStatsFactory(statsFactory ? std::move(statsFactory)
+                                            : std::make_unique<WorkerTransportStatsFactory>());
+
+        // With unified event loops the QUIC workers and the H2 acceptors share one
+        // event loop per thread, and with it the per-loop handler pools and caches
+        std::shared_ptr<folly::IOThreadPoolExecutor> ioExecutor;
+        if (params.unifiedEventLoops)
         {
-            server.setStatsFactory(std::move(statsFactory));
+            ioExecutor = std::make_shared<folly::IOThreadPoolExecutor>(
+                getUnifiedLoopCount(params),
+                std::make_shared<folly::NamedThreadFactory>("SampleWorker"));
+            server.start(ioExecutor);
+        }
+        else
+        {
+            server.start();
         }
-
-        server.start();
         // Wait until the quic server initializes
         server.getAddress();
-        h2server.join();
+        // The H2 listener takes the idle timeout of the default transport profile at
+        // startup; it has no per-connection hook, so a reload does not reach it
+        auto h2Params = params;
+        if (auto idleTimeout = server.getTransportProfiles().getDefaultIdleTimeout())
+        {
+            h2Params.httpServerIdleTimeout = *idleTimeout;
+        }
+        auto h2Server = H2Server::create(h2Params, dispatchFn);
+        auto h2thread = H2Server::run(*h2Server, ioExecutor);
+
+        folly::EventBase signalEvb;
+        ServerSignalHandler signalHandler(&signalEvb, params, server);
+
+        folly::FunctionScheduler scheduler;
+        if (params.workerStatsInterval.count() > 0)
+        {
+            scheduler.addFunction(
+                [&server]
+                {
+                    server.logWorkerStats();
+                },
+                params.workerStatsInterval,
+                "worker-stats");
+        }
+        if (!params.ticketKeyFile.empty() && params.ticketKeyReloadInterval.count() > 0)
+        {
+            scheduler.addFunction(
+                [&server]
+                {
+                    server.reloadTicketSecrets();
+                },
+                params.ticketKeyReloadInterval,
+                "ticket-keys",
+                params.ticketKeyReloadInterval);
+        }
+        scheduler.start();
+
+        signalEvb.loopForever();
+        scheduler.shutdown();
+        server.logWorkerStats();
         server.stop();
+        // With unified event loops stopping the H2 server joins the shared loops, so it
+        // goes after QUIC
+        h2Server->stop();
+        h2thread.join();
+
+        auto datagramStats = DatagramBatcher::getStats();
+        LOG(INFO) << "Datagram echo: queued=" << datagramStats.queued
+                  << " flushed=" << datagramStats.flushed << " dropped=" << datagramStats.dropped;
+        auto ticketStats = RotatingTicketCipher::getStats();
+        LOG(INFO) << "Session tickets: issued=" << ticketStats.issued
+                  << " resumed=" << ticketStats.resumed << " rejected=" << ticketStats.rejected;
+        auto replayStats = BoundedReplayCache::getStats();
+        LOG(INFO) << "0-RTT replay cache: checks=" << replayStats.checks
+                  << " replays=" << replayStats.replays << " evictions=" << replayStats.evictions
+                  << " degraded=" << replayStats.degraded;
+        auto certStats = CompressionCountingCert::getStats();
+        LOG(INFO) << "Certificate messages: uncompressed=" << certStats.uncompressed;
+        for (size_t i = 0; i < kCertCompressionAlgorithms.size(); ++i)
+        {
+            LOG(INFO) << "Certificate messages: " << fizz::toString(kCertCompressionAlgorithms[i])
+                      << "=" << certStats.compressed[i] << " saved=" << certStats.bytesSaved[i]
+                      << " bytes";
+        }
+        auto signStats = OffloadSelfCert::getStats();
+        if (signStats.signUs.count() > 0)
+        {
+            LOG(INFO) << "Offloaded signatures: " << signStats.signUs.count()
+                      << " queue p99=" << signStats.queueUs.quantile(0.99)
+                      << "us sign p50=" << signStats.signUs.quantile(0.5)
+                      << "us p99=" << signStats.signUs.quantile(0.99) << "us";
+        }
+        if (!params.transportProfilesFile.empty())
+        {
+            auto profileStats = TransportProfiles::getStats();
+            LOG(INFO) << "Transport profiles: reloads=" << profileStats.reloads
+                      << " failures=" << profileStats.reloadFailures
+                      << " alpn_overrides=" << profileStats.alpnOverrides;
+        }
+        LOG(INFO) << "Devious baton stream states still live: "
+                  << DeviousBatonHandler::getLiveStreamStates();
     }
 }  // namespace quic::samples
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseLocal.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace quic::samples
+{
+    class BaseSampleHandler;
+
+    // Takes a handler back once its transaction has been detached
+    class HandlerRecycler
+    {
+    public:
+        virtual ~HandlerRecycler() = default;
+
+        virtual void recycle(BaseSampleHandler* handler) noexcept = 0;
+    };
+
+    struct HandlerPoolStats
+    {
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t recycled  = 0;
+        uint64_t discarded = 0;
+    };
+
+    /**
+     * Per-EventBase free list of handler objects.
+     *
+     * Handlers are acquired and recycled only on the worker thread owning the pool, so
+     * the free list needs no locking. Counters are written by that thread only and
+     * summed across pools when read.
+     */
+    template <class T>
+    class HandlerPool : public HandlerRecycler
+    {
+    public:
+        static constexpr size_t kMaxFreeHandlers = 1024;
+
+        HandlerPool()
+        {
+            pools.wlock()->push_back(this);
+        }
+
+        ~HandlerPool() override
+        {
+            auto lockedPools = pools.wlock();
+            lockedPools->erase(std::remove(lockedPools->begin(), lockedPools->end(), this),
+                               lockedPools->end());
+        }
+
+        HandlerPool(const HandlerPool&)            = delete;
+        HandlerPool& operator=(const HandlerPool&) = delete;
+
+        static HandlerPool& get(folly::EventBase* eventBase)
+        {
+            return local.try_emplace(*eventBase);
+        }
+
+        // Constructor arguments are only used on a miss; pooled handlers of the same
+        // type must be interchangeable after reset()
+        template <class... Args>
+        T* acquire(Args&&... args)
+        {
+            if (freeList.empty())
+            {
+                misses.fetch_add(1, std::memory_order_relaxed);
+                auto handler = new T(std::forward<Args>(args)...);
+                handler->setRecycler(this);
+                return handler;
+            }
+            hits.fetch_add(1, std::memory_order_relaxed);
+            auto handler = freeList.back().release();
+            freeList.pop_back();
+            return handler;
+        }
+
+        void recycle(BaseSampleHandler* handler) noexcept override
+        {
+            auto typedHandler = static_cast<T*>(handler);
+            if (freeList.size() >= kMaxFreeHandlers)
+            {
+                discarded.fetch_add(1, std::memory_order_relaxed);
+                delete typedHandler;
+                return;
+            }
+            typedHandler->reset();
+            freeList.emplace_back(typedHandler);
+            recycled.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static HandlerPoolStats getStats()
+        {
+            HandlerPoolStats stats;
+            auto lockedPools = pools.rlock();
+            for (auto pool : *lockedPools)
+            {
+                stats.hits += pool->hits.load(std::memory_order_relaxed);
+                stats.misses += pool->misses.load(std::memory_order_relaxed);
+                stats.recycled += pool->recycled.load(std::memory_order_relaxed);
+                stats.discarded += pool->discarded.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+    private:
+        static inline folly::EventBaseLocal<HandlerPool> local;
+        static inline folly::Synchronized<std::vector<HandlerPool*>> pools;
+
+        std::vector<std::unique_ptr<T>> freeList;
+        std::atomic<uint64_t> hits {0};
+        std::atomic<uint64_t> misses {0};
+        std::atomic<uint64_t> recycled {0};
+        std::atomic<uint64_t> discarded {0};
+    };
+}  // namespace quic::samples
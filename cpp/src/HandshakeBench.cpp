@@ -0,0 +1,581 @@
+#include "HandshakeBench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/FileUtil.h>
+#include <folly/container/F14Map.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/json.h>
+#include <proxygen/lib/http/SynchronizedLruQuicPskCache.h>
+#include <quic/client/QuicClientTransport.h>
+#include <quic/client/handshake/ClientHandshake.h>
+#include <quic/client/state/ClientStateMachine.h>
+#include <quic/common/events/FollyQuicEventBase.h>
+#include <quic/common/events/HighResQuicTimer.h>
+#include <quic/common/udpsocket/FollyQuicAsyncUDPSocket.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/fizz/client/handshake/FizzClientQuicHandshakeContext.h>
+
+#include "FizzContext.h"
+#include "HQServer.h"
+#include "InsecureVerifierDangerousDoNotUseInProduction.h"
+
+namespace
+{
+    using namespace quic::samples;
+    using Clock = std::chrono::steady_clock;
+
+    // How long a priming connection waits for its session ticket
+    constexpr auto kTicketPollInterval     = std::chrono::milliseconds(10);
+    constexpr uint32_t kTicketPollAttempts = 100;
+
+    enum class HandshakeType
+    {
+        FULL,
+        RESUMED,
+        ZERO_RTT,
+    };
+
+    const char* getName(HandshakeType type)
+    {
+        switch (type)
+        {
+            case HandshakeType::FULL:
+                return "full";
+            case HandshakeType::RESUMED:
+                return "resumed";
+            case HandshakeType::ZERO_RTT:
+                return "0rtt";
+        }
+        return "unknown";
+    }
+
+    // Results of the handshakes run by one thread, merged once every thread is done
+    struct PhaseStats
+    {
+        std::vector<uint64_t> handshakeUs;
+        uint64_t completed = 0;
+        uint64_t failed    = 0;
+        // Handshakes the server resumed from a ticket
+        uint64_t resumed = 0;
+        // Handshakes that could send 0-RTT data, and those whose 0-RTT the server took
+        uint64_t earlyDataAttempted = 0;
+        uint64_t earlyDataAccepted  = 0;
+        // First counted handshake started, last one done; priming is excluded
+        Clock::time_point firstStart;
+        Clock::time_point lastDone;
+
+        void merge(const PhaseStats& other)
+        {
+            if (firstStart == Clock::time_point() ||
+                (other.firstStart != Clock::time_point() && other.firstStart < firstStart))
+            {
+                firstStart = other.firstStart;
+            }
+            handshakeUs.insert(handshakeUs.end(),
+                               other.handshakeUs.begin(),
+                               other.handshakeUs.end());
+            completed += other.completed;
+            failed += other.failed;
+            resumed += other.resumed;
+            earlyDataAttempted += other.earlyDataAttempted;
+            earlyDataAccepted += other.earlyDataAccepted;
+            lastDone = std::max(lastDone, other.lastDone);
+        }
+    };
+
+    uint64_t elapsedUs(Clock::time_point since, Clock::time_point until = Clock::now())
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(until - since).count();
+    }
+
+    uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+        auto index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+        return sorted[index];
+    }
+
+    /**
+     * One QUIC connection that is closed as soon as its handshake is replay safe, or,
+     * when priming, once its session ticket has reached the PSK cache.
+     */
+    class HandshakeConnection : private quic::QuicSocket::ConnectionSetupCallback
+    {
+    public:
+        using DoneFn = std::function<void(HandshakeConnection&)>;
+
+        HandshakeConnection(const HQToolClientParams& clientParams,
+                            folly::EventBase* evb,
+                            std::shared_ptr<quic::FollyQuicEventBase> quicEvb,
+                            quic::QuicTimer::SharedPtr timer,
+                            std::shared_ptr<quic::QuicPskCache> cache,
+                            FizzClientContextPtr fizzClientContext,
+                            bool priming,
+                            DoneFn doneFn);
+
+        ~HandshakeConnection() override;
+
+        void start();
+
+        [[nodiscard]] bool isFailed() const
+        {
+            return failed;
+        }
+
+        [[nodiscard]] bool isResumed() const
+        {
+            return resumed;
+        }
+
+        [[nodiscard]] bool isEarlyDataAttempted() const
+        {
+            return earlyDataReady;
+        }
+
+        [[nodiscard]] bool isEarlyDataAccepted() const
+        {
+            return earlyDataAccepted;
+        }
+
+        [[nodiscard]] uint64_t getHandshakeUs() const
+        {
+            return handshakeUs;
+        }
+
+    private:
+        void onConnectionSetupError(quic::QuicError code) noexcept override;
+
+        void onTransportReady() noexcept override;
+
+        void onReplaySafe() noexcept override;
+
+        void waitForTicket(uint32_t attempts);
+
+        void finish();
+
+        const HQToolClientParams& params;
+        folly::EventBase* eventBase = nullptr;
+        std::shared_ptr<quic::FollyQuicEventBase> qEvb;
+        quic::QuicTimer::SharedPtr pacingTimer;
+        std::shared_ptr<quic::QuicPskCache> pskCache;
+        FizzClientContextPtr fizzContext;
+        DoneFn onDone;
+
+        std::shared_ptr<quic::QuicClientTransport> quicClient;
+        Clock::time_point startTime;
+        uint64_t handshakeUs   = 0;
+        bool primeTicket       = false;
+        bool starting          = false;
+        bool earlyDataReady    = false;
+        bool earlyDataAccepted = false;
+        bool resumed           = false;
+        bool failed            = false;
+        bool finished          = false;
+    };
+
+    HandshakeConnection::HandshakeConnection(const HQToolClientParams& clientParams,
+                                             folly::EventBase* evb,
+                                             std::shared_ptr<quic::FollyQuicEventBase> quicEvb,
+                                             quic::QuicTimer::SharedPtr timer,
+                                             std::shared_ptr<quic::QuicPskCache> cache,
+                                             FizzClientContextPtr fizzClientContext,
+                                             bool priming,
+                                             DoneFn doneFn) :
+        params(clientParams), eventBase(evb), qEvb(std::move(quicEvb)),
+        pacingTimer(std::move(timer)), pskCache(std::move(cache)),
+        fizzContext(std::move(fizzClientContext)), onDone(std::move(doneFn)),
+        primeTicket(priming)
+    {
+    }
+
+    HandshakeConnection::~HandshakeConnection()
+    {
+        if (quicClient)
+        {
+            quicClient->setConnectionSetupCallback(nullptr);
+            quicClient->closeNow(folly::none);
+        }
+    }
+
+    void HandshakeConnection::start()
+    {
+        auto sock   = std::make_unique<quic::FollyQuicAsyncUDPSocket>(qEvb);
+        auto client = std::make_shared<quic::QuicClientTransport>(
+            qEvb,
+            std::move(sock),
+            quic::FizzClientQuicHandshakeContext::Builder()
+                .setFizzClientContext(fizzContext)
+                .setCertificateVerifier(
+                    std::make_unique<proxygen::InsecureVerifierDangerousDoNotUseInProduction>())
+                .setPskCache(pskCache)
+                .build());
+        client->setPacingTimer(pacingTimer);
+        client->setHostname(params.host);
+        client->addNewPeerAddress(params.remoteAddress.value());
+        client->setCongestionControllerFactory(
+            std::make_shared<quic::DefaultCongestionControllerFactory>());
+        client->setTransportSettings(params.transportSettings);
+        client->setSupportedVersions(params.quicVersions);
+
+        quicClient = std::move(client);
+        startTime  = Clock::now();
+        // With a usable ticket and early data the transport is ready before any
+        // packet was exchanged, i.e. within start()
+        starting = true;
+        quicClient->start(this, nullptr);
+        starting = false;
+    }
+
+    void HandshakeConnection::onConnectionSetupError(quic::QuicError code) noexcept
+    {
+        LOG(ERROR) << "Handshake failed: " << code.message;
+        quicClient->setConnectionSetupCallback(nullptr);
+        failed = true;
+        finish();
+    }
+
+    void HandshakeConnection::onTransportReady() noexcept
+    {
+        if (starting)
+        {
+            earlyDataReady = true;
+        }
+    }
+
+    void HandshakeConnection::onReplaySafe() noexcept
+    {
+        handshakeUs = elapsedUs(startTime);
+        resumed     = quicClient->isTLSResumed();
+        if (earlyDataReady)
+        {
+            // Set once the server's handshake messages said whether it took the 0-RTT
+            auto state =
+                static_cast<const quic::QuicClientConnectionState*>(quicClient->getState());
+
+            auto rejected     = state->clientHandshakeLayer->getZeroRttRejected();
+            earlyDataAccepted = rejected.has_value() && !*rejected;
+        }
+        if (primeTicket)
+        {
+            waitForTicket(kTicketPollAttempts);
+            return;
+        }
+        finish();
+    }
+
+    void HandshakeConnection::waitForTicket(uint32_t attempts)
+    {
+        // The ticket arrives after the handshake, once the server saw our Finished
+        if (pskCache->getPsk(params.host) || attempts == 0)
+        {
+            finish();
+            return;
+        }
+        eventBase->runAfterDelay(
+            [this, attempts]
+            {
+                waitForTicket(attempts - 1);
+            },
+            kTicketPollInterval.count());
+    }
+
+    void HandshakeConnection::finish()
+    {
+        if (finished)
+        {
+            return;
+        }
+        finished = true;
+        quicClient->setConnectionSetupCallback(nullptr);
+        quicClient->close(folly::none);
+        onDone(*this);
+    }
+
+    /**
+     * Runs the handshakes of one phase on one thread, keeping up to
+     * handshakeBenchConcurrency of them in flight.
+     */
+    class PhaseRunner
+    {
+    public:
+        PhaseRunner(const HQToolClientParams& clientParams,
+                    HandshakeType handshakeType,
+                    uint32_t handshakes);
+
+        PhaseStats run();
+
+    private:
+        void startConnection(bool priming);
+
+        void onDone(HandshakeConnection& connection, bool priming);
+
+        const HQToolClientParams& params;
+        HandshakeType type;
+        uint32_t remaining = 0;
+
+        folly::EventBase evb;
+        std::shared_ptr<quic::FollyQuicEventBase> qEvb;
+        quic::QuicTimer::SharedPtr pacingTimer;
+        std::shared_ptr<quic::QuicPskCache> pskCache;
+        // Priming connections never send early data
+        FizzClientContextPtr primingContext;
+        FizzClientContextPtr fizzContext;
+        folly::F14FastMap<HandshakeConnection*, std::unique_ptr<HandshakeConnection>> connections;
+        PhaseStats stats;
+    };
+
+    PhaseRunner::PhaseRunner(const HQToolClientParams& clientParams,
+                             HandshakeType handshakeType,
+                             uint32_t handshakes) :
+        params(clientParams), type(handshakeType), remaining(handshakes),
+        qEvb(std::make_shared<quic::FollyQuicEventBase>(&evb))
+    {
+        if (params.transportSettings.pacingEnabled)
+        {
+            pacingTimer = std::make_shared<quic::HighResQuicTimer>(
+                &evb,
+                params.transportSettings.pacingTimerResolution);
+        }
+        if (type != HandshakeType::FULL)
+        {
+            // Private to the thread so that every phase starts without tickets
+            pskCache       = std::make_shared<proxygen::SynchronizedLruQuicPskCache>(16);
+            primingContext = createFizzClientContext(params, false);
+        }
+        // Shared by the thread's connections, building one per handshake would load
+        // the client certificate every time
+        fizzContext = createFizzClientContext(params, type == HandshakeType::ZERO_RTT);
+    }
+
+    PhaseStats PhaseRunner::run()
+    {
+        if (remaining > 0)
+        {
+            if (pskCache)
+            {
+                startConnection(true);
+            }
+            else
+            {
+                for (uint32_t i = 0; i < params.handshakeBenchConcurrency && remaining > 0; ++i)
+                {
+                    startConnection(false);
+                }
+            }
+            evb.loop();
+        }
+        return std::move(stats);
+    }
+
+    void PhaseRunner::startConnection(bool priming)
+    {
+        if (!priming)
+        {
+            --remaining;
+            if (stats.firstStart == Clock::time_point())
+            {
+                stats.firstStart = Clock::now();
+            }
+        }
+        auto connection = std::make_unique<HandshakeConnection>(
+            params,
+            &evb,
+            qEvb,
+            pacingTimer,
+            pskCache,
+            priming ? primingContext : fizzContext,
+            priming,
+            [this, priming](HandshakeConnection& done)
+            {
+                onDone(done, priming);
+            });
+        auto raw = connection.get();
+        connections.emplace(raw, std::move(connection));
+        raw->start();
+    }
+
+    void PhaseRunner::onDone(HandshakeConnection& connection, bool priming)
+    {
+        if (priming)
+        {
+            if (connection.isFailed())
+            {
+                LOG(ERROR) << "Priming connection failed, " << getName(type)
+                           << " handshakes will be full ones";
+            }
+        }
+        else
+        {
+            stats.lastDone = Clock::now();
+            if (connection.isFailed())
+            {
+                ++stats.failed;
+            }
+            else
+            {
+                ++stats.completed;
+                stats.handshakeUs.push_back(connection.getHandshakeUs());
+                stats.resumed += connection.isResumed() ? 1 : 0;
+                stats.earlyDataAttempted += connection.isEarlyDataAttempted() ? 1 : 0;
+                stats.earlyDataAccepted += connection.isEarlyDataAccepted() ? 1 : 0;
+            }
+        }
+
+        // Called from the transport's own callback, release it on the next iteration
+        evb.runInLoop(
+            [this, raw = &connection]
+            {
+                connections.erase(raw);
+            });
+
+        auto toStart = priming ? params.handshakeBenchConcurrency : 1;
+        for (uint32_t i = 0; i < toStart && remaining > 0; ++i)
+        {
+            startConnection(false);
+        }
+    }
+
+    folly::dynamic runPhase(const HQToolClientParams& params, HandshakeType type)
+    {
+        // startClient() only runs the benchmark with at least one connection, so the
+        // clamp bounds are ordered
+        auto threads = std::clamp<uint32_t>(params.handshakeBenchThreads,
+                                            1,
+                                            params.handshakeBenchConnections);
+        std::vector<PhaseStats> results(threads);
+        std::vector<std::thread> workers;
+        for (uint32_t thread = 0; thread < threads; ++thread)
+        {
+            // Spread the handshakes evenly, the first threads take the remainder
+            auto handshakes = params.handshakeBenchConnections / threads +
+                              (thread < params.handshakeBenchConnections % threads ? 1 : 0);
+            workers.emplace_back(
+                [&params, &results, thread, type, handshakes]
+                {
+                    results[thread] = PhaseRunner(params, type, handshakes).run();
+                });
+        }
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        PhaseStats total;
+        for (const auto& result : results)
+        {
+            total.merge(result);
+        }
+        std::sort(total.handshakeUs.begin(), total.handshakeUs.end());
+        auto elapsed = std::max<uint64_t>(elapsedUs(total.firstStart, total.lastDone), 1);
+        auto rate    = static_cast<double>(total.completed) * 1000000 / elapsed;
+
+        LOG(INFO) << getName(type) << " handshakes: " << total.completed << " completed, "
+                  << total.failed << " failed, " << total.resumed << " resumed, "
+                  << total.earlyDataAttempted << " attempted 0-RTT, " << total.earlyDataAccepted
+                  << " accepted in " << elapsed / 1000 << " ms ("
+                  << static_cast<uint64_t>(rate) << "/s)";
+        LOG(INFO) << getName(type)
+                  << " handshake latency us: p50=" << percentile(total.handshakeUs, 0.5)
+                  << " p90=" << percentile(total.handshakeUs, 0.9)
+                  << " p99=" << percentile(total.handshakeUs, 0.99)
+                  << " max=" << percentile(total.handshakeUs, 1.0);
+
+        folly::dynamic latency = folly::dynamic::object;
+        latency["p50"]         = percentile(total.handshakeUs, 0.5);
+        latency["p90"]         = percentile(total.handshakeUs, 0.9);
+        latency["p99"]         = percentile(total.handshakeUs, 0.99);
+        latency["max"]         = percentile(total.handshakeUs, 1.0);
+
+        folly::dynamic result           = folly::dynamic::object;
+        result["completed"]             = total.completed;
+        result["failed"]                = total.failed;
+        result["resumed"]               = total.resumed;
+        result["early_data_attempted"]  = total.earlyDataAttempted;
+        result["early_data_accepted"]   = total.earlyDataAccepted;
+        result["elapsed_us"]            = elapsed;
+        result["handshakes_per_second"] = rate;
+        result["latency_us"]            = std::move(latency);
+        return result;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    int runHandshakeBench(const HQToolClientParams& params)
+    {
+        HQToolClientParams benchParams = params;
+        std::unique_ptr<ScopedHQServer> server;
+        if (params.handshakeBenchLocal)
+        {
+            MyHQServerParams serverParams;
+            static_cast<MyHQBaseParams&>(serverParams) = params;
+            serverParams.serverThreads                 = params.handshakeBenchServerThreads;
+            serverParams.localAddress                  = folly::SocketAddress("127.0.0.1", 0);
+            // No request is ever sent, connections close after the handshake
+            server = ScopedHQServer::start(serverParams,
+                                           [](proxygen::HTTPMessage*)
+                                               -> proxygen::HTTPTransactionHandler*
+                                           {
+                                               return nullptr;
+                                           });
+            benchParams.remoteAddress = server->getAddress();
+        }
+
+        std::vector<HandshakeType> types;
+        for (const auto& name : params.handshakeBenchTypes)
+        {
+            for (auto type :
+                 {HandshakeType::FULL, HandshakeType::RESUMED, HandshakeType::ZERO_RTT})
+            {
+                if (name == getName(type))
+                {
+                    types.push_back(type);
+                }
+            }
+        }
+
+        LOG(INFO) << "Running " << params.handshakeBenchConnections
+                  << " handshakes per type on " << params.handshakeBenchThreads << " threads, "
+                  << params.handshakeBenchConcurrency << " in flight each, against "
+                  << benchParams.remoteAddress->describe();
+
+        folly::dynamic phases = folly::dynamic::object;
+        bool failed           = false;
+        for (auto type : types)
+        {
+            auto result           = runPhase(benchParams, type);
+            failed               |= result["failed"].asInt() > 0;
+            phases[getName(type)] = std::move(result);
+        }
+        server.reset();
+
+        if (!params.handshakeBenchOutput.empty())
+        {
+            folly::dynamic report  = folly::dynamic::object;
+            report["timestamp"]    = static_cast<int64_t>(std::time(nullptr));
+            report["server"]       = benchParams.remoteAddress->describe();
+            report["local_server"] = params.handshakeBenchLocal;
+            report["threads"]      = params.handshakeBenchThreads;
+            report["concurrency"]  = params.handshakeBenchConcurrency;
+            report["connections"]  = params.handshakeBenchConnections;
+            report["phases"]       = std::move(phases);
+            if (!folly::writeFile(folly::toPrettyJson(report) + "\n",
+                                  params.handshakeBenchOutput.c_str()))
+            {
+                PLOG(ERROR) << "Failed to write " << params.handshakeBenchOutput;
+                return -1;
+            }
+        }
+        return failed ? -1 : 0;
+    }
+}  // namespace quic::samples
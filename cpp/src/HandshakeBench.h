@@ -0,0 +1,20 @@
+#pragma once
+
+#include "HQCommandLine.h"
+
+namespace quic::samples
+{
+    /**
+     * Handshake rate benchmark.
+     *
+     * Runs handshakeBenchConnections QUIC handshakes per handshake type (full, resumed,
+     * 0-RTT), at most handshakeBenchConcurrency in flight per thread, and closes each
+     * connection once it is replay safe. With handshakeBenchLocal a ScopedHQServer is
+     * started in-process on loopback instead of connecting to remoteAddress. Logs
+     * handshakes per second and latency percentiles per type and, if
+     * handshakeBenchOutput is set, writes them as JSON.
+     *
+     * Returns 0 when every handshake succeeded.
+     */
+    int runHandshakeBench(const HQToolClientParams& params);
+}  // namespace quic::samples
@@ -0,0 +1,130 @@
+#include "LoopLagMonitor.h"
+
+#include <folly/io/async/EventBaseManager.h>
+#include <algorithm>
+
+namespace
+{
+    using namespace quic::samples;
+
+    // The lag has reached an enabled stage threshold
+    bool exceeds(std::chrono::microseconds lag, std::chrono::milliseconds threshold)
+    {
+        return threshold.count() > 0 && lag >= threshold;
+    }
+
+    bool stillAbove(std::chrono::microseconds lag, std::chrono::milliseconds threshold)
+    {
+        return threshold.count() > 0 && lag * 2 >= threshold;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    void LoopLagMonitor::start(folly::EventBase* evb, const LoopLagThresholds& thresholds)
+    {
+        evb->dcheckIsInEventBaseThread();
+        local.emplace(*evb, std::make_unique<LoopLagMonitor>(evb, thresholds));
+    }
+
+    LoopLagMonitor* LoopLagMonitor::getCurrent()
+    {
+        auto evb = folly::EventBaseManager::get()->getExistingEventBase();
+        if (!evb)
+        {
+            return nullptr;
+        }
+        auto monitor = local.get(*evb);
+        return monitor ? monitor->get() : nullptr;
+    }
+
+    OverloadLevel LoopLagMonitor::getCurrentLevel()
+    {
+        auto monitor = getCurrent();
+        return monitor ? monitor->level.load(std::memory_order_relaxed) : OverloadLevel::NONE;
+    }
+
+    void LoopLagMonitor::recordShed()
+    {
+        if (auto monitor = getCurrent())
+        {
+            monitor->shedRequests.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<LoopLagSnapshot> LoopLagMonitor::getSnapshots()
+    {
+        std::vector<LoopLagSnapshot> result;
+        auto lockedMonitors = allMonitors.rlock();
+        result.reserve(lockedMonitors->size());
+        for (auto monitor : *lockedMonitors)
+        {
+            result.push_back({
+                .eventBase    = monitor->eventBase,
+                .lag          = std::chrono::microseconds(monitor->lagUs.load()),
+                .level        = monitor->level.load(),
+                .shedRequests = monitor->shedRequests.load(),
+            });
+        }
+        return result;
+    }
+
+    LoopLagMonitor::LoopLagMonitor(folly::EventBase* evb, const LoopLagThresholds& lagThresholds) :
+        folly::AsyncTimeout(evb), eventBase(evb), thresholds(lagThresholds)
+    {
+        allMonitors.wlock()->push_back(this);
+        schedule();
+    }
+
+    LoopLagMonitor::~LoopLagMonitor()
+    {
+        auto lockedMonitors = allMonitors.wlock();
+        lockedMonitors->erase(
+            std::remove(lockedMonitors->begin(), lockedMonitors->end(), this),
+            lockedMonitors->end());
+    }
+
+    void LoopLagMonitor::schedule()
+    {
+        expectedAt = std::chrono::steady_clock::now() + kSampleInterval;
+        scheduleTimeout(kSampleInterval);
+    }
+
+    void LoopLagMonitor::timeoutExpired() noexcept
+    {
+        auto lag = std::max(std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - expectedAt),
+                            std::chrono::microseconds(0));
+        // EWMA with a weight of 1/8, about 160ms of history at the sample interval
+        smoothedLag = (smoothedLag * 7 + lag) / 8;
+        lagUs.store(smoothedLag.count(), std::memory_order_relaxed);
+        auto newLevel = computeLevel(smoothedLag);
+        if (newLevel != level.load(std::memory_order_relaxed))
+        {
+            LOG(INFO) << "Worker loop lag " << smoothedLag.count() << "us, overload level "
+                      << static_cast<int>(level.load()) << " -> " << static_cast<int>(newLevel);
+            level.store(newLevel, std::memory_order_relaxed);
+        }
+        schedule();
+    }
+
+    OverloadLevel LoopLagMonitor::computeLevel(std::chrono::microseconds smoothed) const
+    {
+        const std::pair<OverloadLevel, std::chrono::milliseconds> stages[] = {
+            {OverloadLevel::SHED, thresholds.shed},
+            {OverloadLevel::REJECT, thresholds.reject},
+            {OverloadLevel::RETRY, thresholds.retry},
+        };
+        auto current = level.load(std::memory_order_relaxed);
+        for (const auto& [stage, threshold] : stages)
+        {
+            // Enter at the threshold, stay until the lag drops below half of it
+            if (exceeds(smoothed, threshold) ||
+                (current >= stage && stillAbove(smoothed, threshold)))
+            {
+                return stage;
+            }
+        }
+        return OverloadLevel::NONE;
+    }
+}  // namespace quic::samples
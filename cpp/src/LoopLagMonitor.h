@@ -0,0 +1,97 @@
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseLocal.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace quic::samples
+{
+    // Admission stages, each one implies the ones before it
+    enum class OverloadLevel : uint8_t
+    {
+        NONE,
+        // New connections must validate their address with a stateless retry
+        RETRY,
+        // New connections are rejected
+        REJECT,
+        // Low-priority requests on existing connections get a 503
+        SHED,
+    };
+
+    // Smoothed loop lag entering each stage, zero disables the stage. Enabled stages
+    // must not decrease, since computeLevel() returns the highest stage reached.
+    struct LoopLagThresholds
+    {
+        std::chrono::milliseconds retry {0};
+        std::chrono::milliseconds reject {0};
+        std::chrono::milliseconds shed {0};
+
+        [[nodiscard]] bool enabled() const noexcept
+        {
+            return retry.count() > 0 || reject.count() > 0 || shed.count() > 0;
+        }
+    };
+
+    struct LoopLagSnapshot
+    {
+        folly::EventBase* eventBase = nullptr;
+        std::chrono::microseconds lag {0};
+        OverloadLevel level = OverloadLevel::NONE;
+        uint64_t shedRequests = 0;
+    };
+
+    /**
+     * Measures how late a periodic timer fires on one worker EventBase.
+     *
+     * The lag is smoothed with an EWMA and mapped to an OverloadLevel. A stage is
+     * entered at its threshold and left below half of it, so the level does not
+     * flap around a threshold. The level is read by the admission hooks on the
+     * same worker thread through getCurrentLevel().
+     */
+    class LoopLagMonitor : private folly::AsyncTimeout
+    {
+    public:
+        static constexpr std::chrono::milliseconds kSampleInterval {20};
+
+        // Starts monitoring evb; must be called on its thread
+        static void start(folly::EventBase* evb, const LoopLagThresholds& thresholds);
+
+        // Level of the calling thread's EventBase, NONE when it is not monitored
+        static OverloadLevel getCurrentLevel();
+
+        // Counts a request shed on the calling thread's EventBase
+        static void recordShed();
+
+        // One entry per monitored worker, in start order
+        static std::vector<LoopLagSnapshot> getSnapshots();
+
+        LoopLagMonitor(folly::EventBase* evb, const LoopLagThresholds& thresholds);
+
+        ~LoopLagMonitor() override;
+
+    private:
+        void timeoutExpired() noexcept override;
+
+        void schedule();
+
+        [[nodiscard]] OverloadLevel computeLevel(std::chrono::microseconds smoothed) const;
+
+        static LoopLagMonitor* getCurrent();
+
+        static inline folly::EventBaseLocal<std::unique_ptr<LoopLagMonitor>> local;
+        static inline folly::Synchronized<std::vector<LoopLagMonitor*>> allMonitors;
+
+        folly::EventBase* eventBase = nullptr;
+        LoopLagThresholds thresholds;
+        std::chrono::steady_clock::time_point expectedAt;
+        std::chrono::microseconds smoothedLag {0};
+        // Written on the worker thread, read by getSnapshots()
+        std::atomic<int64_t> lagUs {0};
+        std::atomic<OverloadLevel> level {OverloadLevel::NONE};
+        std::atomic<uint64_t> shedRequests {0};
+    };
+}  // namespace quic::samples
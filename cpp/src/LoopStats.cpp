@@ -0,0 +1,232 @@
+#include "LoopStats.h"
+
+#include <folly/io/async/EventBaseManager.h>
+#include <folly/system/ThreadName.h>
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+    uint64_t load(const std::atomic<uint64_t>& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+    // Single writer, see Log2Histogram
+    void bump(std::atomic<uint64_t>& counter, uint64_t value = 1) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    void Log2Histogram::add(uint64_t value) noexcept
+    {
+        // Values below 2^i land in bucket i
+        auto bucket = std::min<size_t>(std::bit_width(value), kBuckets - 1);
+        bump(counts[bucket]);
+        bump(sum, value);
+    }
+
+    Log2Histogram::Snapshot Log2Histogram::snapshot() const
+    {
+        Snapshot result;
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            result.counts[i] = load(counts[i]);
+        }
+        result.sum = load(sum);
+        return result;
+    }
+
+    uint64_t Log2Histogram::Snapshot::count() const
+    {
+        uint64_t total = 0;
+        for (auto bucketCount : counts)
+        {
+            total += bucketCount;
+        }
+        return total;
+    }
+
+    uint64_t Log2Histogram::Snapshot::quantile(double q) const
+    {
+        auto total = count();
+        if (total == 0)
+        {
+            return 0;
+        }
+        auto rank     = static_cast<uint64_t>(q * total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            seen += counts[i];
+            if (seen > rank)
+            {
+                return getUpperBound(i);
+            }
+        }
+        return getUpperBound(kBuckets - 1);
+    }
+
+    class LoopStats::Observer : public folly::EventBaseObserver
+    {
+    public:
+        explicit Observer(LoopStats& loopStats) : stats(loopStats) {}
+
+        uint32_t getSampleRate() const override
+        {
+            return 1;
+        }
+
+        void loopSample(int64_t busyTime, int64_t idleTime) override
+        {
+            stats.onLoopSample(busyTime, idleTime);
+        }
+
+    private:
+        LoopStats& stats;
+    };
+
+    LoopStats::CallbackTimer::CallbackTimer(Handler handler, Phase phase) noexcept
+    {
+        auto evb = folly::EventBaseManager::get()->getExistingEventBase();
+        if (!evb)
+        {
+            return;
+        }
+        if (auto stats = local.get(*evb))
+        {
+            histogram = &(*stats)->counters.callbackUs[static_cast<size_t>(handler)]
+                                                      [static_cast<size_t>(phase)];
+            start     = std::chrono::steady_clock::now();
+        }
+    }
+
+    LoopStats::CallbackTimer::~CallbackTimer()
+    {
+        if (histogram)
+        {
+            histogram->add(std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+        }
+    }
+
+    void LoopStats::install(folly::EventBase* evb)
+    {
+        evb->dcheckIsInEventBaseThread();
+        if (local.get(*evb))
+        {
+            return;
+        }
+        auto& stats = *local.emplace(*evb, std::make_unique<LoopStats>(evb));
+        if (evb->getObserver())
+        {
+            LOG(WARNING) << "EventBase of " << stats->threadName
+                         << " already has an observer, not recording loop utilisation";
+            return;
+        }
+        evb->setObserver(std::make_shared<Observer>(*stats));
+    }
+
+    LoopStats::LoopStats(folly::EventBase* evb) :
+        eventBase(evb), threadName(folly::getCurrentThreadName().value_or("unknown"))
+    {
+        allStats.wlock()->push_back(this);
+    }
+
+    LoopStats::~LoopStats()
+    {
+        auto lockedStats = allStats.wlock();
+        lockedStats->erase(std::remove(lockedStats->begin(), lockedStats->end(), this),
+                           lockedStats->end());
+    }
+
+    void LoopStats::onLoopSample(int64_t busyTimeUs, int64_t idleTimeUs) noexcept
+    {
+        auto busyUs = static_cast<uint64_t>(std::max<int64_t>(busyTimeUs, 0));
+        bump(counters.busyUs, busyUs);
+        bump(counters.idleUs, static_cast<uint64_t>(std::max<int64_t>(idleTimeUs, 0)));
+        counters.loopBusyUs.add(busyUs);
+        counters.queueDepth.add(eventBase->getNotificationQueueSize());
+    }
+
+    std::vector<LoopStats::Snapshot> LoopStats::getSnapshots()
+    {
+        std::vector<Snapshot> result;
+        auto lockedStats = allStats.rlock();
+        result.reserve(lockedStats->size());
+        for (auto stats : *lockedStats)
+        {
+            auto& snapshot      = result.emplace_back();
+            snapshot.eventBase  = stats->eventBase;
+            snapshot.threadName = stats->threadName;
+            snapshot.busyUs     = load(stats->counters.busyUs);
+            snapshot.idleUs     = load(stats->counters.idleUs);
+            snapshot.loopBusyUs = stats->counters.loopBusyUs.snapshot();
+            snapshot.queueDepth = stats->counters.queueDepth.snapshot();
+            for (size_t handler = 0; handler < kHandlers; ++handler)
+            {
+                for (size_t phase = 0; phase < kPhases; ++phase)
+                {
+                    snapshot.callbackUs[handler][phase] =
+                        stats->counters.callbackUs[handler][phase].snapshot();
+                }
+            }
+        }
+        return result;
+    }
+
+    const char* LoopStats::getName(Handler handler)
+    {
+        switch (handler)
+        {
+            case Handler::ECHO:
+                return "echo";
+            case Handler::DEVIOUS_BATON:
+                return "devious_baton";
+            case Handler::PUSH:
+                return "push";
+            case Handler::TEST:
+                return "test";
+            default:
+                return "unknown";
+        }
+    }
+
+    const char* LoopStats::getName(Phase phase)
+    {
+        return phase == Phase::READ ? "read" : "write";
+    }
+
+    void LoopStats::dump()
+    {
+        for (const auto& snapshot : getSnapshots())
+        {
+            auto totalUs = snapshot.busyUs + snapshot.idleUs;
+            LOG(INFO) << "Loop " << snapshot.threadName << ": busy "
+                      << (totalUs ? 100 * snapshot.busyUs / totalUs : 0) << "%, iterations "
+                      << snapshot.loopBusyUs.count() << ", busy p50/p99 <"
+                      << snapshot.loopBusyUs.quantile(0.5) << "/<"
+                      << snapshot.loopBusyUs.quantile(0.99) << "us, queue depth p99 <"
+                      << snapshot.queueDepth.quantile(0.99);
+            for (size_t handler = 0; handler < kHandlers; ++handler)
+            {
+                for (size_t phase = 0; phase < kPhases; ++phase)
+                {
+                    const auto& callbacks = snapshot.callbackUs[handler][phase];
+                    if (callbacks.count() == 0)
+                    {
+                        continue;
+                    }
+                    LOG(INFO) << "  " << getName(static_cast<Handler>(handler)) << " handler "
+                              << getName(static_cast<Phase>(phase)) << " callbacks: calls "
+                              << callbacks.count() << ", total " << callbacks.sum
+                              << "us, p99 <" << callbacks.quantile(0.99) << "us";
+                }
+            }
+        }
+    }
+}  // namespace quic::samples
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventBaseLocal.h>
+#include <folly/lang/Align.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace quic::samples
+{
+    /**
+     * Power-of-two histogram: bucket i counts values below 2^i, the last bucket
+     * everything else. Written by one thread, read by any.
+     */
+    class Log2Histogram
+    {
+    public:
+        static constexpr size_t kBuckets = 24;
+
+        struct Snapshot
+        {
+            std::array<uint64_t, kBuckets> counts {};
+            uint64_t sum = 0;
+
+            [[nodiscard]] uint64_t count() const;
+
+            // Upper bound of the bucket holding the given quantile
+            [[nodiscard]] uint64_t quantile(double q) const;
+        };
+
+        static constexpr uint64_t getUpperBound(size_t bucket)
+        {
+            return uint64_t(1) << bucket;
+        }
+
+        void add(uint64_t value) noexcept;
+
+        [[nodiscard]] Snapshot snapshot() const;
+
+    private:
+        std::array<std::atomic<uint64_t>, kBuckets> counts {};
+        std::atomic<uint64_t> sum {0};
+    };
+
+    /**
+     * Utilisation of one worker EventBase, QUIC or H2.
+     *
+     * Loop iteration busy and idle time and the pending callback queue depth come
+     * from a folly::EventBaseObserver sampling every iteration. Handler callback
+     * time is recorded by CallbackTimer at the sample handler entry points, split
+     * into ingress (READ) and egress (WRITE) callbacks. It covers only the handlers'
+     * own code: QUIC transport and HTTP codec work shows up in busy time alone.
+     */
+    class LoopStats
+    {
+    public:
+        enum class Handler : uint8_t
+        {
+            ECHO,
+            DEVIOUS_BATON,
+            PUSH,
+            TEST,
+            COUNT,
+        };
+
+        enum class Phase : uint8_t
+        {
+            READ,
+            WRITE,
+            COUNT,
+        };
+
+        static constexpr size_t kHandlers = static_cast<size_t>(Handler::COUNT);
+        static constexpr size_t kPhases   = static_cast<size_t>(Phase::COUNT);
+
+        struct Snapshot
+        {
+            folly::EventBase* eventBase = nullptr;
+            std::string threadName;
+            uint64_t busyUs = 0;
+            uint64_t idleUs = 0;
+            Log2Histogram::Snapshot loopBusyUs;
+            Log2Histogram::Snapshot queueDepth;
+            std::array<std::array<Log2Histogram::Snapshot, kPhases>, kHandlers> callbackUs;
+        };
+
+        // Times one handler callback on the current worker, a no-op off worker loops
+        class CallbackTimer
+        {
+        public:
+            CallbackTimer(Handler handler, Phase phase) noexcept;
+
+            ~CallbackTimer();
+
+            CallbackTimer(const CallbackTimer&)            = delete;
+            CallbackTimer& operator=(const CallbackTimer&) = delete;
+
+        private:
+            Log2Histogram* histogram = nullptr;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        // Starts recording on evb; must be called on its thread, repeated calls are no-ops.
+        // The observer takes the EventBase's only observer slot; if another observer is
+        // already set it is kept and only handler callback time is recorded.
+        static void install(folly::EventBase* evb);
+
+        // One entry per instrumented worker, in install order
+        static std::vector<Snapshot> getSnapshots();
+
+        static const char* getName(Handler handler);
+
+        static const char* getName(Phase phase);
+
+        // Logs a per-worker summary, e.g. on SIGUSR2
+        static void dump();
+
+        explicit LoopStats(folly::EventBase* evb);
+
+        ~LoopStats();
+
+        LoopStats(const LoopStats&)            = delete;
+        LoopStats& operator=(const LoopStats&) = delete;
+
+    private:
+        class Observer;
+
+        void onLoopSample(int64_t busyTimeUs, int64_t idleTimeUs) noexcept;
+
+        static inline folly::EventBaseLocal<std::unique_ptr<LoopStats>> local;
+        static inline folly::Synchronized<std::vector<LoopStats*>> allStats;
+
+        folly::EventBase* eventBase = nullptr;
+        std::string threadName;
+        // Own cache lines, only the worker writes
+        struct alignas(folly::hardware_destructive_interference_size) Counters
+        {
+            std::atomic<uint64_t> busyUs {0};
+            std::atomic<uint64_t> idleUs {0};
+            Log2Histogram loopBusyUs;
+            Log2Histogram queueDepth;
+            std::array<std::array<Log2Histogram, kPhases>, kHandlers> callbackUs;
+        };
+        Counters counters;
+    };
+}  // namespace quic::samples
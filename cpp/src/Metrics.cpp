@@ -0,0 +1,431 @@
+#include "Metrics.h"
+
+#include <fizz/record/Types.h>
+#include <folly/Format.h>
+
+#include "CertCompression.h"
+#include "DatagramBatcher.h"
+#include "LoopLagMonitor.h"
+#include "LoopStats.h"
+#include "ReplayCache.h"
+#include "SampleHandler.h"
+#include "SignOffload.h"
+#include "TicketCipher.h"
+#include "TransportProfiles.h"
+#include "WorkerTransportStats.h"
+
+namespace
+{
+    using namespace quic::samples;
+
+    void addHeader(std::string& out, const char* name, const char* type, const char* help)
+    {
+        folly::format(&out, "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+    }
+
+    template <class Field>
+    void addWorkerCounter(std::string& out,
+                          const std::vector<WorkerStatsSnapshot>& snapshots,
+                          const char* name,
+                          const char* help,
+                          Field field)
+    {
+        addHeader(out, name, "counter", help);
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            folly::format(&out, "{}{{worker=\"{}\"}} {}\n", name, i, snapshots[i].*field);
+        }
+    }
+
+    void addRttHistogram(std::string& out, const std::vector<WorkerStatsSnapshot>& snapshots)
+    {
+        constexpr auto kName = "quic_rtt_microseconds";
+        addHeader(out, kName, "histogram", "RTT samples per QUIC worker");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            const auto& rtt     = snapshots[i].rtt;
+            uint64_t cumulative = 0;
+            for (size_t bucket = 0; bucket < kRttBucketBoundsUs.size(); ++bucket)
+            {
+                cumulative += rtt.counts[bucket];
+                folly::format(&out,
+                              "{}_bucket{{worker=\"{}\",le=\"{}\"}} {}\n",
+                              kName,
+                              i,
+                              kRttBucketBoundsUs[bucket],
+                              cumulative);
+            }
+            cumulative += rtt.counts.back();
+            folly::format(
+                &out, "{}_bucket{{worker=\"{}\",le=\"+Inf\"}} {}\n", kName, i, cumulative);
+            folly::format(&out, "{}_sum{{worker=\"{}\"}} {}\n", kName, i, rtt.sumUs);
+            folly::format(&out, "{}_count{{worker=\"{}\"}} {}\n", kName, i, cumulative);
+        }
+    }
+
+    void addTransportStats(std::string& out)
+    {
+        auto snapshots = WorkerTransportStats::getSnapshots();
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_packets_received_total",
+                         "UDP packets received",
+                         &WorkerStatsSnapshot::packetsReceived);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_packets_sent_total",
+                         "QUIC packets sent",
+                         &WorkerStatsSnapshot::packetsSent);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_packets_dropped_total",
+                         "Packets dropped by the server",
+                         &WorkerStatsSnapshot::packetsDropped);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_packets_lost_total",
+                         "Packets declared lost",
+                         &WorkerStatsSnapshot::packetsLost);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_retransmissions_total",
+                         "Packets retransmitted",
+                         &WorkerStatsSnapshot::retransmissions);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_ptos_total",
+                         "Probe timeouts fired",
+                         &WorkerStatsSnapshot::ptos);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_read_bytes_total",
+                         "Bytes read from UDP sockets",
+                         &WorkerStatsSnapshot::bytesRead);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_written_bytes_total",
+                         "Bytes written to UDP sockets",
+                         &WorkerStatsSnapshot::bytesWritten);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_connections_opened_total",
+                         "Connections accepted",
+                         &WorkerStatsSnapshot::newConnections);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_connections_closed_total",
+                         "Connections closed",
+                         &WorkerStatsSnapshot::closedConnections);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_streams_opened_total",
+                         "Streams opened",
+                         &WorkerStatsSnapshot::streamsOpened);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_streams_closed_total",
+                         "Streams closed",
+                         &WorkerStatsSnapshot::streamsClosed);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_streams_reset_total",
+                         "Streams reset",
+                         &WorkerStatsSnapshot::streamsReset);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_zero_rtt_accepted_total",
+                         "Connections whose 0-RTT data was accepted",
+                         &WorkerStatsSnapshot::zeroRttAccepted);
+        addWorkerCounter(out,
+                         snapshots,
+                         "quic_zero_rtt_rejected_total",
+                         "Connections whose 0-RTT data was rejected",
+                         &WorkerStatsSnapshot::zeroRttRejected);
+        addRttHistogram(out, snapshots);
+    }
+
+    void addTicketStats(std::string& out)
+    {
+        auto stats = RotatingTicketCipher::getStats();
+        addHeader(out, "tls_tickets_issued_total", "counter", "Session tickets issued");
+        folly::format(&out, "tls_tickets_issued_total {}\n", stats.issued);
+        addHeader(out,
+                  "tls_tickets_presented_total",
+                  "counter",
+                  "Session tickets presented by clients, by outcome");
+        folly::format(
+            &out, "tls_tickets_presented_total{{result=\"resumed\"}} {}\n", stats.resumed);
+        folly::format(
+            &out, "tls_tickets_presented_total{{result=\"rejected\"}} {}\n", stats.rejected);
+    }
+
+    void addCertCompressionStats(std::string& out)
+    {
+        auto stats = CompressionCountingCert::getStats();
+        addHeader(out,
+                  "tls_cert_messages_total",
+                  "counter",
+                  "Certificate messages sent, by compression algorithm");
+        folly::format(
+            &out, "tls_cert_messages_total{{algorithm=\"none\"}} {}\n", stats.uncompressed);
+        for (size_t i = 0; i < kCertCompressionAlgorithms.size(); ++i)
+        {
+            folly::format(&out,
+                          "tls_cert_messages_total{{algorithm=\"{}\"}} {}\n",
+                          fizz::toString(kCertCompressionAlgorithms[i]),
+                          stats.compressed[i]);
+        }
+        addHeader(out,
+                  "tls_cert_compression_saved_bytes_total",
+                  "counter",
+                  "Handshake bytes saved by certificate compression");
+        for (size_t i = 0; i < kCertCompressionAlgorithms.size(); ++i)
+        {
+            folly::format(&out,
+                          "tls_cert_compression_saved_bytes_total{{algorithm=\"{}\"}} {}\n",
+                          fizz::toString(kCertCompressionAlgorithms[i]),
+                          stats.bytesSaved[i]);
+        }
+    }
+
+    void addReplayCacheStats(std::string& out)
+    {
+        auto stats = BoundedReplayCache::getStats();
+        const std::pair<const char*, uint64_t> counters[] = {
+            {"checks", stats.checks},
+            {"replays", stats.replays},
+            {"evictions", stats.evictions},
+            {"degraded", stats.degraded},
+        };
+        addHeader(out,
+                  "tls_replay_cache_total",
+                  "counter",
+                  "0-RTT replay cache checks, detected replays, early evictions and checks "
+                  "refused while degraded");
+        for (const auto& [event, value] : counters)
+        {
+            folly::format(&out, "tls_replay_cache_total{{event=\"{}\"}} {}\n", event, value);
+        }
+    }
+
+    void addTransportProfileStats(std::string& out)
+    {
+        auto stats = TransportProfiles::getStats();
+        addHeader(out,
+                  "transport_profile_loads_total",
+                  "counter",
+                  "Transport profile file loads, by outcome");
+        folly::format(&out,
+                      "transport_profile_loads_total{{result=\"ok\"}} {}\n"
+                      "transport_profile_loads_total{{result=\"failed\"}} {}\n",
+                      stats.reloads,
+                      stats.reloadFailures);
+        addHeader(out,
+                  "transport_profile_alpn_overrides_total",
+                  "counter",
+                  "Connections whose receive window was set by their ALPN profile");
+        folly::format(&out, "transport_profile_alpn_overrides_total {}\n", stats.alpnOverrides);
+    }
+
+    // labels is the label list without braces, e.g. loop="0"
+    void addLog2Histogram(std::string& out,
+                          const char* name,
+                          const std::string& labels,
+                          const Log2Histogram::Snapshot& histogram)
+    {
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket + 1 < Log2Histogram::kBuckets; ++bucket)
+        {
+            cumulative += histogram.counts[bucket];
+            folly::format(&out,
+                          "{}_bucket{{{},le=\"{}\"}} {}\n",
+                          name,
+                          labels,
+                          Log2Histogram::getUpperBound(bucket),
+                          cumulative);
+        }
+        cumulative += histogram.counts.back();
+        folly::format(&out, "{}_bucket{{{},le=\"+Inf\"}} {}\n", name, labels, cumulative);
+        folly::format(&out, "{}_sum{{{}}} {}\n", name, labels, histogram.sum);
+        folly::format(&out, "{}_count{{{}}} {}\n", name, labels, cumulative);
+    }
+
+    void addSignOffloadStats(std::string& out)
+    {
+        auto stats = OffloadSelfCert::getStats();
+        addHeader(out, "tls_sign_pending", "gauge", "Signatures queued or running on the pool");
+        folly::format(&out, "tls_sign_pending {}\n", stats.pending);
+        addHeader(out,
+                  "tls_sign_microseconds",
+                  "histogram",
+                  "Handshake signatures offloaded to the pool, time queued and time signing");
+        addLog2Histogram(out, "tls_sign_microseconds", "stage=\"queue\"", stats.queueUs);
+        addLog2Histogram(out, "tls_sign_microseconds", "stage=\"sign\"", stats.signUs);
+    }
+
+    void addLoopStats(std::string& out)
+    {
+        auto snapshots = LoopStats::getSnapshots();
+        std::vector<std::string> labels;
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            labels.push_back(
+                folly::sformat("loop=\"{}\",thread=\"{}\"", i, snapshots[i].threadName));
+        }
+
+        addHeader(out, "event_loop_busy_microseconds_total", "counter", "Time spent working");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            folly::format(&out,
+                          "event_loop_busy_microseconds_total{{{}}} {}\n",
+                          labels[i],
+                          snapshots[i].busyUs);
+        }
+        addHeader(out, "event_loop_idle_microseconds_total", "counter", "Time spent waiting");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            folly::format(&out,
+                          "event_loop_idle_microseconds_total{{{}}} {}\n",
+                          labels[i],
+                          snapshots[i].idleUs);
+        }
+        addHeader(out,
+                  "event_loop_iteration_microseconds",
+                  "histogram",
+                  "Busy time of each loop iteration");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            addLog2Histogram(
+                out, "event_loop_iteration_microseconds", labels[i], snapshots[i].loopBusyUs);
+        }
+        addHeader(out,
+                  "event_loop_queue_depth",
+                  "histogram",
+                  "Callbacks queued for the loop, sampled every iteration");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            addLog2Histogram(out, "event_loop_queue_depth", labels[i], snapshots[i].queueDepth);
+        }
+        addHeader(out,
+                  "handler_callback_microseconds",
+                  "histogram",
+                  "Time spent in sample handler ingress (read) and egress (write) "
+                  "callbacks, excluding QUIC transport and HTTP codec work");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            for (size_t handler = 0; handler < LoopStats::kHandlers; ++handler)
+            {
+                for (size_t phase = 0; phase < LoopStats::kPhases; ++phase)
+                {
+                    const auto& callbacks = snapshots[i].callbackUs[handler][phase];
+                    if (callbacks.count() == 0)
+                    {
+                        continue;
+                    }
+                    addLog2Histogram(
+                        out,
+                        "handler_callback_microseconds",
+                        folly::sformat("{},handler=\"{}\",phase=\"{}\"",
+                                       labels[i],
+                                       LoopStats::getName(static_cast<LoopStats::Handler>(handler)),
+                                       LoopStats::getName(static_cast<LoopStats::Phase>(phase))),
+                        callbacks);
+                }
+            }
+        }
+    }
+
+    void addLoopLag(std::string& out)
+    {
+        auto snapshots = LoopLagMonitor::getSnapshots();
+        if (snapshots.empty())
+        {
+            return;
+        }
+        addHeader(out, "event_loop_lag_microseconds", "gauge", "Smoothed worker loop lag");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            folly::format(&out,
+                          "event_loop_lag_microseconds{{worker=\"{}\"}} {}\n",
+                          i,
+                          snapshots[i].lag.count());
+        }
+        addHeader(out, "overload_level", "gauge", "0 none, 1 retry, 2 reject, 3 shed");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            folly::format(&out,
+                          "overload_level{{worker=\"{}\"}} {}\n",
+                          i,
+                          static_cast<int>(snapshots[i].level));
+        }
+        addHeader(out, "shed_requests_total", "counter", "Requests answered with a 503");
+        for (size_t i = 0; i < snapshots.size(); ++i)
+        {
+            folly::format(
+                &out, "shed_requests_total{{worker=\"{}\"}} {}\n", i, snapshots[i].shedRequests);
+        }
+    }
+
+    template <class T>
+    void addHandlerPool(std::string& out, const char* handler)
+    {
+        auto stats = HandlerPool<T>::getStats();
+        folly::format(&out,
+                      "handler_pool_acquires_total{{handler=\"{}\",result=\"hit\"}} {}\n"
+                      "handler_pool_acquires_total{{handler=\"{}\",result=\"miss\"}} {}\n",
+                      handler,
+                      stats.hits,
+                      handler,
+                      stats.misses);
+    }
+
+    void addHandlerStats(std::string& out, const RouteTable& routes)
+    {
+        addHeader(out, "http_route_requests_total", "counter", "Requests dispatched per route");
+        for (const auto& [path, hits] : routes.getHits())
+        {
+            folly::format(&out, "http_route_requests_total{{route=\"{}\"}} {}\n", path, hits);
+        }
+
+        addHeader(out, "handler_pool_acquires_total", "counter", "Pooled handler acquisitions");
+        addHandlerPool<EchoHandler>(out, "echo");
+        addHandlerPool<ServerPushHandler>(out, "push");
+        addHandlerPool<DummyHandler>(out, "dummy");
+
+        auto datagrams = DatagramBatcher::getStats();
+        addHeader(out, "webtransport_echo_datagrams_total", "counter", "Echoed datagrams");
+        folly::format(&out,
+                      "webtransport_echo_datagrams_total{{result=\"queued\"}} {}\n"
+                      "webtransport_echo_datagrams_total{{result=\"flushed\"}} {}\n"
+                      "webtransport_echo_datagrams_total{{result=\"dropped\"}} {}\n",
+                      datagrams.queued,
+                      datagrams.flushed,
+                      datagrams.dropped);
+
+        addHeader(out,
+                  "devious_baton_live_stream_states",
+                  "gauge",
+                  "Devious baton streams with parser state");
+        folly::format(&out,
+                      "devious_baton_live_stream_states {}\n",
+                      DeviousBatonHandler::getLiveStreamStates());
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    std::string renderMetrics(const RouteTable& routes)
+    {
+        std::string out;
+        addTransportStats(out);
+        addTicketStats(out);
+        addReplayCacheStats(out);
+        addCertCompressionStats(out);
+        addSignOffloadStats(out);
+        addTransportProfileStats(out);
+        addLoopStats(out);
+        addLoopLag(out);
+        addHandlerStats(out, routes);
+        return out;
+    }
+}  // namespace quic::samples
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "RouteTable.h"
+
+namespace quic::samples
+{
+    /**
+     * Renders the server counters in the Prometheus text exposition format.
+     *
+     * Every source keeps per-worker counters that only their worker writes; they are
+     * summed (or labelled per worker) here, on the scraping thread, so a scrape only
+     * takes the registry locks and never blocks packet or request processing.
+     */
+    std::string renderMetrics(const RouteTable& routes);
+}  // namespace quic::samples
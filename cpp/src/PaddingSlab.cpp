@@ -0,0 +1,46 @@
+#include "PaddingSlab.h"
+
+#include <algorithm>
+#include <array>
+
+namespace quic::samples
+{
+    const uint8_t* PaddingSlab::data()
+    {
+        alignas(64) static const auto slab = []
+        {
+            std::array<uint8_t, kSlabSize> result;
+            result.fill(kFill);
+            return result;
+        }();
+        return slab.data();
+    }
+
+    std::unique_ptr<folly::IOBuf> PaddingSlab::get(size_t length)
+    {
+        std::unique_ptr<folly::IOBuf> head;
+        while (length > 0)
+        {
+            auto pieceLength = std::min(length, kSlabSize);
+            auto piece       = folly::IOBuf::wrapBuffer(data(), pieceLength);
+            if (head)
+            {
+                head->prependChain(std::move(piece));
+            }
+            else
+            {
+                head = std::move(piece);
+            }
+            length -= pieceLength;
+        }
+        return head;
+    }
+
+    void PaddingSlab::append(folly::IOBuf& chain, size_t length)
+    {
+        if (auto padding = get(length))
+        {
+            chain.prependChain(std::move(padding));
+        }
+    }
+}  // namespace quic::samples
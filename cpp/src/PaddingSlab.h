@@ -0,0 +1,29 @@
+#pragma once
+
+#include <folly/io/IOBuf.h>
+#include <memory>
+
+namespace quic::samples
+{
+    /**
+     * Process-wide read-only block of padding bytes.
+     *
+     * get() returns IOBuf chains whose buffers point into the slab instead of owning
+     * memory, so padding of any length costs one IOBuf header per kSlabSize bytes
+     * and no copy. The slab is static and is never written after initialisation.
+     */
+    class PaddingSlab
+    {
+    public:
+        static constexpr size_t kSlabSize = 64 * 1024;
+        static constexpr uint8_t kFill    = 'a';
+
+        // Returns a chain of `length` padding bytes, nullptr for zero
+        static std::unique_ptr<folly::IOBuf> get(size_t length);
+
+        // Appends `length` padding bytes to the end of the chain
+        static void append(folly::IOBuf& chain, size_t length);
+
+        static const uint8_t* data();
+    };
+}  // namespace quic::samples
@@ -0,0 +1,88 @@
+#include "ReplayCache.h"
+
+#include <folly/Random.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <algorithm>
+
+namespace quic::samples
+{
+    BoundedReplayCache::BoundedReplayCache(std::chrono::milliseconds replayWindow,
+                                           size_t capacity) :
+        window(replayWindow),
+        generationCapacity(std::max<size_t>(capacity / kShards / 2, 1)),
+        hashSeed(folly::Random::secureRand64())
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (auto& shard : shards)
+        {
+            auto locked = shard.lock();
+            locked->current.reserve(generationCapacity);
+            locked->previous.reserve(generationCapacity);
+            locked->generationStart = now;
+        }
+    }
+
+    folly::SemiFuture<fizz::ReplayCacheResult> BoundedReplayCache::check(
+        folly::ByteRange identifier)
+    {
+        // Keyed so that clients cannot aim identifiers at one shard or force collisions
+        auto fingerprint =
+            folly::hash::SpookyHashV2::Hash64(identifier.data(), identifier.size(), hashSeed);
+        auto& shard = shards[fingerprint % kShards];
+        bump(checks);
+        return checkShard(*shard.lock(), fingerprint);
+    }
+
+    fizz::ReplayCacheResult BoundedReplayCache::checkShard(Shard& shard, uint64_t fingerprint)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto age = now - shard.generationStart;
+        if (age >= window)
+        {
+            shard.previous.swap(shard.current);
+            shard.current.clear();
+            if (age >= 2 * window)
+            {
+                shard.previous.clear();
+            }
+            shard.generationStart = now;
+        }
+
+        if (shard.current.contains(fingerprint) || shard.previous.contains(fingerprint))
+        {
+            bump(replays);
+            return fizz::ReplayCacheResult::DefinitelyReplay;
+        }
+
+        if (shard.current.size() >= generationCapacity)
+        {
+            if (!shard.previous.empty())
+            {
+                // The evicted identifiers may still be inside their window
+                bump(evictions, shard.previous.size());
+                shard.degradedUntil = now + window;
+            }
+            shard.previous.swap(shard.current);
+            shard.current.clear();
+            shard.generationStart = now;
+        }
+        shard.current.insert(fingerprint);
+
+        if (now < shard.degradedUntil)
+        {
+            bump(degraded);
+            return fizz::ReplayCacheResult::MaybeReplay;
+        }
+        return fizz::ReplayCacheResult::NotReplay;
+    }
+
+    ReplayCacheStats BoundedReplayCache::getStats()
+    {
+        return {
+            .checks    = checks.load(std::memory_order_relaxed),
+            .replays   = replays.load(std::memory_order_relaxed),
+            .evictions = evictions.load(std::memory_order_relaxed),
+            .degraded  = degraded.load(std::memory_order_relaxed),
+        };
+    }
+}  // namespace quic::samples
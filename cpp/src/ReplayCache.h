@@ -0,0 +1,73 @@
+#pragma once
+
+#include <fizz/server/ReplayCache.h>
+#include <folly/Synchronized.h>
+#include <folly/container/F14Set.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace quic::samples
+{
+    struct ReplayCacheStats
+    {
+        uint64_t checks    = 0;
+        // Identifiers seen before, their early data was rejected
+        uint64_t replays   = 0;
+        // Identifiers forgotten before their window ended because the cache was full
+        uint64_t evictions = 0;
+        // Checks answered MaybeReplay while evicted identifiers could still be replayed
+        uint64_t degraded  = 0;
+    };
+
+    /**
+     * 0-RTT anti-replay cache shared by all workers of a process, with bounded memory.
+     *
+     * Identifiers are stored as 64-bit keyed hashes in sharded sets. Each shard keeps two
+     * generations, each covering one window. When a generation expires, the older
+     * one is dropped, so an identifier is remembered for at least one window. When the
+     * current generation is full, the older generation is evicted early. The shard then
+     * answers MaybeReplay for one window, which makes fizz fall back to a full
+     * handshake instead of risking a replay.
+     */
+    class BoundedReplayCache : public fizz::server::ReplayCache
+    {
+    public:
+        static constexpr size_t kShards = 16;
+
+        // window should cover the early data clock skew tolerance; capacity bounds the
+        // number of identifiers held across all shards and generations
+        BoundedReplayCache(std::chrono::milliseconds window, size_t capacity);
+
+        folly::SemiFuture<fizz::ReplayCacheResult> check(folly::ByteRange identifier) override;
+
+        static ReplayCacheStats getStats();
+
+    private:
+        struct Shard
+        {
+            folly::F14FastSet<uint64_t> current;
+            folly::F14FastSet<uint64_t> previous;
+            std::chrono::steady_clock::time_point generationStart;
+            std::chrono::steady_clock::time_point degradedUntil;
+        };
+
+        fizz::ReplayCacheResult checkShard(Shard& shard, uint64_t fingerprint);
+
+        static void bump(std::atomic<uint64_t>& counter, uint64_t value = 1) noexcept
+        {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        std::chrono::milliseconds window;
+        size_t generationCapacity = 0;
+        uint64_t hashSeed         = 0;
+        std::array<folly::Synchronized<Shard, std::mutex>, kShards> shards;
+
+        static inline std::atomic<uint64_t> checks {0};
+        static inline std::atomic<uint64_t> replays {0};
+        static inline std::atomic<uint64_t> evictions {0};
+        static inline std::atomic<uint64_t> degraded {0};
+    };
+}  // namespace quic::samples
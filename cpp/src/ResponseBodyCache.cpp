@@ -0,0 +1,54 @@
+#include "ResponseBodyCache.h"
+
+#include <array>
+
+namespace
+{
+    using quic::samples::ResponseBody;
+
+    constexpr size_t kNumBodies = static_cast<size_t>(ResponseBody::NUM_BODIES);
+
+    // clang-format off
+    constexpr std::array<folly::StringPiece, kNumBodies> kBodyData = {
+        // DUMMY
+        "Undefined path...",
+        // H1Q_FOOTER
+        "==============\n"
+        " Hello World! \n"
+        "==============\n",
+        // BAD_REQUEST
+        "bad request...",
+        // PUSH_REQUEST_RESPONSE
+        "I AM THE REQUEST RESPONSE AND I AM RESPONSIBLE",
+        // PUSH_RESPONSE_PREFIX
+        "I AM THE PUSHED RESPONSE AND I AM NOT RESPONSIBLE: ",
+    };
+    // clang-format on
+
+    const std::array<std::unique_ptr<folly::IOBuf>, kNumBodies>& getBodies()
+    {
+        static const auto bodies = []
+        {
+            std::array<std::unique_ptr<folly::IOBuf>, kNumBodies> result;
+            for (size_t i = 0; i < kNumBodies; ++i)
+            {
+                result[i] = folly::IOBuf::copyBuffer(kBodyData[i]);
+            }
+            return result;
+        }();
+        return bodies;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    std::unique_ptr<folly::IOBuf> ResponseBodyCache::get(ResponseBody body)
+    {
+        return getBodies()[static_cast<size_t>(body)]->cloneOne();
+    }
+
+    folly::StringPiece ResponseBodyCache::view(ResponseBody body)
+    {
+        return kBodyData[static_cast<size_t>(body)];
+    }
+}  // namespace quic::samples
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+#include <memory>
+
+namespace quic::samples
+{
+    // Canned reply bodies used by the sample handlers
+    enum class ResponseBody
+    {
+        DUMMY,
+        H1Q_FOOTER,
+        BAD_REQUEST,
+        PUSH_REQUEST_RESPONSE,
+        PUSH_RESPONSE_PREFIX,
+        NUM_BODIES,
+    };
+
+    /**
+     * Process-wide registry of immutable response bodies.
+     *
+     * Every body is copied into an IOBuf once, on first use. get() returns a
+     * cloneOne() sharing that buffer, so a response only costs an IOBuf header;
+     * the shared buffer is never written to since it always has another owner.
+     */
+    class ResponseBodyCache
+    {
+    public:
+        static std::unique_ptr<folly::IOBuf> get(ResponseBody body);
+
+        static folly::StringPiece view(ResponseBody body);
+    };
+}  // namespace quic::samples
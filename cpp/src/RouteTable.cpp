@@ -0,0 +1,302 @@
+#include "RouteTable.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    bool edgeLess(const std::pair<char, uint32_t>& edge, char value)
+    {
+        return edge.first < value;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    folly::StringPiece RouteMatch::getParam(folly::StringPiece name) const
+    {
+        for (size_t i = 0; i < numParams; ++i)
+        {
+            if (names[i] == name)
+            {
+                return values[i];
+            }
+        }
+        return {};
+    }
+
+    RouteTable::Builder& RouteTable::Builder::exact(std::string path, RouteHandlerFactory factory)
+    {
+        routes.push_back({std::move(path), Kind::EXACT, std::move(factory)});
+        return *this;
+    }
+
+    RouteTable::Builder& RouteTable::Builder::prefix(std::string prefix,
+                                                     RouteHandlerFactory factory)
+    {
+        routes.push_back({std::move(prefix), Kind::PREFIX, std::move(factory)});
+        return *this;
+    }
+
+    RouteTable::Builder& RouteTable::Builder::pattern(std::string pattern,
+                                                      RouteHandlerFactory factory)
+    {
+        routes.push_back({std::move(pattern), Kind::PATTERN, std::move(factory)});
+        return *this;
+    }
+
+    RouteTable::Builder& RouteTable::Builder::fallback(RouteHandlerFactory factory)
+    {
+        if (hasFallback)
+        {
+            throw std::invalid_argument("Fallback route registered twice");
+        }
+        hasFallback = true;
+        routes.push_back({"*", Kind::FALLBACK, std::move(factory)});
+        return *this;
+    }
+
+    RouteTable RouteTable::Builder::build()
+    {
+        if (!hasFallback)
+        {
+            throw std::invalid_argument("Route table requires a fallback route");
+        }
+
+        RouteTable table;
+        table.routes = std::move(routes);
+        table.hits   = std::make_unique<std::atomic<uint64_t>[]>(table.routes.size());
+        table.nodes.emplace_back();
+
+        for (uint32_t routeId = 0; routeId < table.routes.size(); ++routeId)
+        {
+            const auto& route = table.routes[routeId];
+            switch (route.kind)
+            {
+                case Kind::EXACT:
+                {
+                    if (!table.exactRoutes.emplace(route.path, routeId).second)
+                    {
+                        throw std::invalid_argument("Duplicate exact route: " + route.path);
+                    }
+                    break;
+                }
+
+                case Kind::PREFIX:
+                {
+                    auto nodeIndex = table.insertLiteral(route.path);
+                    auto& node     = table.nodes[nodeIndex];
+                    if (node.prefixRoute >= 0)
+                    {
+                        throw std::invalid_argument("Duplicate prefix route: " + route.path);
+                    }
+                    node.prefixRoute = static_cast<int32_t>(routeId);
+                    break;
+                }
+
+                case Kind::PATTERN:
+                {
+                    folly::StringPiece spec(route.path);
+                    auto firstParam = spec.find(':');
+                    if (firstParam == folly::StringPiece::npos)
+                    {
+                        throw std::invalid_argument("Pattern route without parameters: "
+                                                    + route.path);
+                    }
+
+                    Pattern pattern;
+                    pattern.routeId  = routeId;
+                    size_t numParams = 0;
+                    size_t pos       = firstParam;
+                    while (pos < spec.size())
+                    {
+                        Segment segment;
+                        auto end = spec.find('/', pos);
+                        if (end == folly::StringPiece::npos)
+                        {
+                            end = spec.size();
+                        }
+                        if (spec[pos] == ':')
+                        {
+                            segment.isParam = true;
+                            segment.text    = spec.subpiece(pos + 1, end - pos - 1).str();
+                            if (segment.text.empty() || ++numParams > RouteMatch::kMaxParams)
+                            {
+                                throw std::invalid_argument("Invalid pattern route: "
+                                                            + route.path);
+                            }
+                        }
+                        else
+                        {
+                            // literal text up to the next parameter
+                            end = spec.find(':', pos);
+                            if (end == folly::StringPiece::npos)
+                            {
+                                end = spec.size();
+                            }
+                            segment.text = spec.subpiece(pos, end - pos).str();
+                        }
+                        pattern.tail.push_back(std::move(segment));
+                        pos = end;
+                    }
+
+                    auto nodeIndex = table.insertLiteral(spec.subpiece(0, firstParam));
+                    table.nodes[nodeIndex].patterns.push_back(
+                        static_cast<uint32_t>(table.patterns.size()));
+                    table.patterns.push_back(std::move(pattern));
+                    break;
+                }
+
+                case Kind::FALLBACK:
+                    table.fallbackRoute = routeId;
+                    break;
+            }
+        }
+
+        return table;
+    }
+
+    uint32_t RouteTable::insertLiteral(folly::StringPiece literal)
+    {
+        uint32_t node = 0;
+        for (char c : literal)
+        {
+            auto child = findChild(node, c);
+            if (child >= 0)
+            {
+                node = child;
+                continue;
+            }
+
+            auto next = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+            nodes[next].parent = node;
+            nodes[next].depth  = nodes[node].depth + 1;
+
+            auto& children = nodes[node].children;
+            children.insert(std::lower_bound(children.begin(), children.end(), c, edgeLess),
+                            {c, next});
+            node = next;
+        }
+        return node;
+    }
+
+    int32_t RouteTable::findChild(uint32_t node, char c) const
+    {
+        const auto& children = nodes[node].children;
+        auto position = std::lower_bound(children.begin(), children.end(), c, edgeLess);
+        if (position == children.end() || position->first != c)
+        {
+            return -1;
+        }
+        return static_cast<int32_t>(position->second);
+    }
+
+    bool RouteTable::matchPattern(const Pattern& pattern,
+                                  folly::StringPiece rest,
+                                  RouteMatch& result) const
+    {
+        size_t pos       = 0;
+        result.numParams = 0;
+        for (const auto& segment : pattern.tail)
+        {
+            if (!segment.isParam)
+            {
+                if (!rest.subpiece(pos).startsWith(segment.text))
+                {
+                    return false;
+                }
+                pos += segment.text.size();
+                continue;
+            }
+
+            auto end = rest.find('/', pos);
+            if (end == folly::StringPiece::npos)
+            {
+                end = rest.size();
+            }
+            if (end == pos)
+            {
+                return false;
+            }
+            result.names[result.numParams]  = segment.text;
+            result.values[result.numParams] = rest.subpiece(pos, end - pos);
+            ++result.numParams;
+            pos = end;
+        }
+        return pos == rest.size();
+    }
+
+    const RouteTable::Route& RouteTable::match(folly::StringPiece path, RouteMatch& result) const
+    {
+        result.numParams = 0;
+        auto routeId     = fallbackRoute;
+
+        auto exact = exactRoutes.find(path);
+        if (exact != exactRoutes.end())
+        {
+            routeId = exact->second;
+        }
+        else
+        {
+            // Walk down as far as the path goes, then back up towards the root so
+            // that the longest literal prefix wins
+            uint32_t node = 0;
+            for (char c : path)
+            {
+                auto child = findChild(node, c);
+                if (child < 0)
+                {
+                    break;
+                }
+                node = child;
+            }
+
+            bool found = false;
+            while (!found)
+            {
+                const auto& current = nodes[node];
+                for (auto patternIndex : current.patterns)
+                {
+                    const auto& pattern = patterns[patternIndex];
+                    if (matchPattern(pattern, path.subpiece(current.depth), result))
+                    {
+                        routeId = pattern.routeId;
+                        found   = true;
+                        break;
+                    }
+                }
+                if (!found && current.prefixRoute >= 0)
+                {
+                    routeId = current.prefixRoute;
+                    found   = true;
+                }
+                if (node == 0)
+                {
+                    break;
+                }
+                node = current.parent;
+            }
+        }
+
+        if (routes[routeId].kind != Kind::PATTERN)
+        {
+            // a failed pattern attempt may have left partial captures behind
+            result.numParams = 0;
+        }
+        hits[routeId].fetch_add(1, std::memory_order_relaxed);
+        result.routeId = routeId;
+        return routes[routeId];
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> RouteTable::getHits() const
+    {
+        std::vector<std::pair<std::string, uint64_t>> result;
+        result.reserve(routes.size());
+        for (size_t i = 0; i < routes.size(); ++i)
+        {
+            result.emplace_back(routes[i].path, hits[i].load(std::memory_order_relaxed));
+        }
+        return result;
+    }
+}  // namespace quic::samples
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/container/F14Map.h>
+#include <proxygen/lib/http/HTTPMessage.h>
+#include <proxygen/lib/http/session/HTTPTransaction.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace quic::samples
+{
+    /**
+     * Result of a route lookup. Parameter names and values point into the route
+     * table and the request path respectively, so a lookup never allocates.
+     */
+    struct RouteMatch
+    {
+        static constexpr size_t kMaxParams = 4;
+
+        size_t routeId   = 0;
+        size_t numParams = 0;
+        std::array<folly::StringPiece, kMaxParams> names;
+        std::array<folly::StringPiece, kMaxParams> values;
+
+        [[nodiscard]] folly::StringPiece getParam(folly::StringPiece name) const;
+    };
+
+    using RouteHandlerFactory = std::function<proxygen::HTTPTransactionHandler*(
+        proxygen::HTTPMessage* /* message */, const RouteMatch& /* match */)>;
+
+    /**
+     * Immutable path -> handler index, built once at startup by RouteTable::Builder.
+     *
+     * Lookup order is: exact path, then the longest literal prefix registered in the
+     * trie, where a parameterised pattern ("/push/:size/:count") wins over a plain
+     * prefix ending at the same position. The fallback route handles everything else.
+     */
+    class RouteTable
+    {
+    public:
+        enum class Kind
+        {
+            EXACT,
+            PREFIX,
+            PATTERN,
+            FALLBACK,
+        };
+
+        struct Route
+        {
+            std::string path;
+            Kind kind;
+            RouteHandlerFactory factory;
+        };
+
+        class Builder
+        {
+        public:
+            Builder& exact(std::string path, RouteHandlerFactory factory);
+
+            Builder& prefix(std::string prefix, RouteHandlerFactory factory);
+
+            // Segments starting with ':' capture everything up to the next '/'
+            Builder& pattern(std::string pattern, RouteHandlerFactory factory);
+
+            Builder& fallback(RouteHandlerFactory factory);
+
+            RouteTable build();
+
+        private:
+            std::vector<Route> routes;
+            bool hasFallback = false;
+        };
+
+        RouteTable()                        = default;
+        RouteTable(RouteTable&&)            = default;
+        RouteTable& operator=(RouteTable&&) = default;
+
+        // Finds the route for the given path and bumps its hit counter
+        const Route& match(folly::StringPiece path, RouteMatch& result) const;
+
+        [[nodiscard]] const std::vector<Route>& getRoutes() const noexcept
+        {
+            return routes;
+        }
+
+        // Returns (route path, hits) for every registered route
+        [[nodiscard]] std::vector<std::pair<std::string, uint64_t>> getHits() const;
+
+    private:
+        struct Segment
+        {
+            bool isParam = false;
+            // parameter name or literal text
+            std::string text;
+        };
+
+        struct Pattern
+        {
+            uint32_t routeId = 0;
+            std::vector<Segment> tail;
+        };
+
+        struct Node
+        {
+            uint32_t parent     = 0;
+            uint32_t depth      = 0;
+            int32_t prefixRoute = -1;
+            // sorted by character
+            std::vector<std::pair<char, uint32_t>> children;
+            std::vector<uint32_t> patterns;
+        };
+
+        uint32_t insertLiteral(folly::StringPiece literal);
+
+        [[nodiscard]] int32_t findChild(uint32_t node, char c) const;
+
+        bool matchPattern(const Pattern& pattern,
+                          folly::StringPiece rest,
+                          RouteMatch& result) const;
+
+        std::vector<Route> routes;
+        folly::F14FastMap<std::string, uint32_t> exactRoutes;
+        std::vector<Node> nodes;
+        std::vector<Pattern> patterns;
+        uint32_t fallbackRoute = 0;
+        std::unique_ptr<std::atomic<uint64_t>[]> hits;
+    };
+}  // namespace quic::samples
@@ -1,4 +1,6 @@
 #include "SampleHandler.h"
+#include "Metrics.h"
+#include "PaddingSlab.h"
 #include <proxygen/lib/utils/Logging.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -6,34 +8,111 @@
 
 namespace quic::samples
 {
-    proxygen::HTTPTransactionHandler* Dispatcher::getRequestHandler(proxygen::HTTPMessage* message)
+    namespace
     {
-        DCHECK(message);
-        auto path = message->getPathAsStringPiece();
-        LOG(INFO) << "getRequestHandler! path=" << path;
-        if (path == "/" || path == "/echo")
+        folly::EventBase* getCurrentEventBase()
         {
-            return new EchoHandler(params);
+            return folly::EventBaseManager::get()->getEventBase();
         }
-        if (boost::algorithm::starts_with(path, "/webtransport/devious-baton"))
+
+        template <class T>
+        RouteHandlerFactory makePooledFactory(const HandlerParams& params)
+        {
+            return [&params](proxygen::HTTPMessage*, const RouteMatch&)
+            {
+                return HandlerPool<T>::get(getCurrentEventBase()).acquire(params);
+            };
+        }
+    }  // namespace
+
+    Dispatcher::Dispatcher(HandlerParams handlerParams) : params(std::move(handlerParams))
+    {
+        routes = RouteTable::Builder()
+                     .exact("/", makePooledFactory<EchoHandler>(params))
+                     .exact("/echo", makePooledFactory<EchoHandler>(params))
+                     .prefix("/webtransport/devious-baton",
+                             [this](proxygen::HTTPMessage*, const RouteMatch&)
+                             {
+                                 return new DeviousBatonHandler(params, getCurrentEventBase());
+                             })
+                     .prefix("/push", makePooledFactory<ServerPushHandler>(params))
+                     .exact("/test",
+                            [this](proxygen::HTTPMessage*, const RouteMatch&)
+                            {
+                                return new TestHandler(params, getCurrentEventBase());
+                            })
+                     .exact("/metrics",
+                            [this](proxygen::HTTPMessage*, const RouteMatch&)
+                            {
+                                return new MetricsHandler(params, routes);
+                            })
+                     .fallback(makePooledFactory<DummyHandler>(params))
+                     .build();
+        // Pushes and unknown paths go first; WebTransport sessions, echo and /metrics
+        // are kept as long as the worker accepts requests at all
+        for (const auto& route : routes.getRoutes())
         {
-            return new DeviousBatonHandler(params, folly::EventBaseManager::get()->getEventBase());
+            sheddableRoutes.push_back(route.kind == RouteTable::Kind::FALLBACK ||
+                                      route.path == "/push");
         }
-        if (boost::algorithm::starts_with(path, "/push"))
+    }
+
+    bool Dispatcher::isLowPriority(const proxygen::HTTPMessage& message, size_t routeId) const
+    {
+        if (sheddableRoutes[routeId])
         {
-            return new ServerPushHandler(params);
+            return true;
         }
-        if (path == "/test")
+        // RFC 9218 urgency, "u=0" (highest) to "u=7", 3 when absent
+        const auto& priority = message.getHeaders().getSingleOrEmpty("priority");
+        auto urgency         = priority.find("u=");
+        return urgency != std::string::npos && urgency + 2 < priority.size() &&
+               priority[urgency + 2] > '3' && priority[urgency + 2] <= '7';
+    }
+
+    proxygen::HTTPTransactionHandler* Dispatcher::getRequestHandler(proxygen::HTTPMessage* message)
+    {
+        DCHECK(message);
+        RouteMatch match;
+        const auto& route = routes.match(message->getPathAsStringPiece(), match);
+        SAMPLE_TRACE(request_dispatch, match.routeId, message->getPathAsStringPiece().size());
+        VLOG(4) << "getRequestHandler! path=" << message->getPathAsStringPiece()
+                << " route=" << route.path;
+        if (LoopLagMonitor::getCurrentLevel() >= OverloadLevel::SHED &&
+            isLowPriority(*message, match.routeId))
         {
-            return new TestHandler(params, folly::EventBaseManager::get()->getEventBase());
+            LoopLagMonitor::recordShed();
+            return new OverloadedHandler(params);
         }
+        return route.factory(message, match);
+    }
 
-        return new DummyHandler(params);
+    void MetricsHandler::onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept
+    {
+        proxygen::HTTPMessage response;
+        response.setVersionString(getHttpVersion());
+        if (message->getMethod() != proxygen::HTTPMethod::GET)
+        {
+            response.setStatusCode(405);
+            response.setStatusMessage("Method Not Allowed");
+            transaction->sendHeaders(response);
+            transaction->sendEOM();
+            return;
+        }
+        auto body = renderMetrics(routes);
+        response.setStatusCode(200);
+        response.setStatusMessage("Ok");
+        response.getHeaders().add(proxygen::HTTP_HEADER_CONTENT_TYPE,
+                                  "text/plain; version=0.0.4");
+        transaction->sendHeaders(response);
+        transaction->sendBody(folly::IOBuf::copyBuffer(body));
+        transaction->sendEOM();
     }
 
     void DeviousBatonHandler::onHeadersComplete(
         std::unique_ptr<proxygen::HTTPMessage> message) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::DEVIOUS_BATON, LoopStats::Phase::READ);
         VLOG(10) << "WebtransportHandler::" << __func__;
         message->dumpMessage(2);
 
@@ -118,7 +197,9 @@ namespace quic::samples
         proxygen::HTTPCodec::StreamID id,
         proxygen::WebTransport::BidiStreamHandle stream) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::DEVIOUS_BATON, LoopStats::Phase::READ);
         VLOG(4) << "Neew Bidi Stream=" << id;
+        SAMPLE_TRACE(stream_open, id, 1);
         stream.readHandle->awaitNextRead(eventBase,
                                          [this](auto readHandle, auto streamData)
                                          {
@@ -130,21 +211,26 @@ namespace quic::samples
         proxygen::HTTPCodec::StreamID id,
         proxygen::WebTransport::StreamReadHandle* readHandle) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::DEVIOUS_BATON, LoopStats::Phase::READ);
     }
 
     void DeviousBatonHandler::onWebTransportSessionClose(folly::Optional<uint32_t> error) noexcept
     {
         VLOG(4) << "Session Close error="
                 << (error ? folly::to<std::string>(*error) : std::string("none"));
+        releaseAllStreamStates();
     }
 
     void DeviousBatonHandler::onDatagram(std::unique_ptr<folly::IOBuf> datagram) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::DEVIOUS_BATON, LoopStats::Phase::READ);
         VLOG(4) << "DeviousBatonHandler::" << __func__;
+        SAMPLE_TRACE(datagram_recv, datagram->computeChainDataLength());
     }
 
     void DeviousBatonHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::DEVIOUS_BATON, LoopStats::Phase::READ);
         VLOG(4) << "DeviousBatonHandler::" << __func__;
         VLOG(3) << proxygen::IOBufPrinter::printHexFolly(body.get(), true);
         folly::io::Cursor cursor(body.get());
@@ -196,18 +282,26 @@ namespace quic::samples
     void DeviousBatonHandler::readHandler(proxygen::WebTransport::StreamReadHandle* readHandle,
                                           folly::Try<proxygen::WebTransport::StreamData> streamData)
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::DEVIOUS_BATON, LoopStats::Phase::READ);
+        auto id = readHandle->getID();
         if (streamData.hasException())
         {
             VLOG(4) << "read error=" << streamData.exception().what();
+            SAMPLE_TRACE(stream_close, id, 1);
+            // The stream was reset, nothing more will arrive on it
+            releaseStreamState(id);
         }
         else
         {
-            VLOG(4) << "read data id =" << readHandle->getID();
-            devious->onStreamData(readHandle->getID(),
-                                  streams[readHandle->getID()],
-                                  std::move(streamData->data),
-                                  streamData->fin);
-            if (!streamData->fin)
+            VLOG(4) << "read data id =" << id;
+            auto fin = streamData->fin;
+            devious->onStreamData(id, getStreamState(id), std::move(streamData->data), fin);
+            if (fin)
+            {
+                SAMPLE_TRACE(stream_close, id, 0);
+                releaseStreamState(id);
+            }
+            else
             {
                 readHandle->awaitNextRead(eventBase,
                                           [this](auto readHandle, auto streamData)
@@ -218,9 +312,63 @@ namespace quic::samples
         }
     }
 
+    devious::DeviousBaton::BatonMessageState& DeviousBatonHandler::getStreamState(uint64_t id)
+    {
+        auto [entry, inserted] = streams.try_emplace(id);
+        if (inserted)
+        {
+            liveStreamStates.live.fetch_add(1, std::memory_order_relaxed);
+        }
+        return entry->second;
+    }
+
+    void DeviousBatonHandler::releaseStreamState(uint64_t id)
+    {
+        if (streams.erase(id) > 0)
+        {
+            liveStreamStates.live.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void DeviousBatonHandler::releaseAllStreamStates()
+    {
+        liveStreamStates.live.fetch_sub(streams.size(), std::memory_order_relaxed);
+        streams.clear();
+    }
+
+    DeviousBatonHandler::WorkerStreamStates::WorkerStreamStates()
+    {
+        allStreamStates.wlock()->push_back(this);
+    }
+
+    DeviousBatonHandler::WorkerStreamStates::~WorkerStreamStates()
+    {
+        auto lockedStates = allStreamStates.wlock();
+        lockedStates->erase(std::remove(lockedStates->begin(), lockedStates->end(), this),
+                            lockedStates->end());
+    }
+
+    DeviousBatonHandler::DeviousBatonHandler(const HandlerParams& params, folly::EventBase* evb) :
+        BaseSampleHandler(params), eventBase(evb),
+        liveStreamStates(localStreamStates.try_emplace(*evb))
+    {
+    }
+
+    uint64_t DeviousBatonHandler::getLiveStreamStates()
+    {
+        uint64_t live = 0;
+        auto lockedStates = allStreamStates.rlock();
+        for (auto workerStates : *lockedStates)
+        {
+            live += workerStates->live.load(std::memory_order_relaxed);
+        }
+        return live;
+    }
+
     void ServerPushHandler::onHeadersComplete(
         std::unique_ptr<proxygen::HTTPMessage> message) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::PUSH, LoopStats::Phase::READ);
         VLOG(10) << "ServerPushHandler::" << __func__;
         message->dumpMessage(2);
         path = message->getPath();
@@ -228,7 +376,7 @@ namespace quic::samples
         if (message->getMethod() != proxygen::HTTPMethod::GET)
         {
             LOG(ERROR) << "Method not supported";
-            sendErrorResponse("bad request...");
+            sendErrorResponse(ResponseBody::BAD_REQUEST);
             return;
         }
 
@@ -237,21 +385,24 @@ namespace quic::samples
                        std::chrono::steady_clock::now().time_since_epoch())
                        .count();
 
-        std::string gPushResponseBody;
         std::vector<std::string> pathPieces;
         std::string copiedPath = path;
         boost::split(pathPieces, copiedPath, boost::is_any_of("/"));
-        int responseSize = 0;
-        int numResponses = 1;
+        size_t responseSize = 0;
+        int numResponses    = 1;
 
         if (pathPieces.size() > 2)
         {
-            auto sizeFromPath = folly::tryTo<int>(pathPieces[2]);
+            auto sizeFromPath = folly::tryTo<size_t>(pathPieces[2]);
             responseSize      = sizeFromPath.value_or(0);
             if (responseSize != 0)
             {
                 VLOG(2) << "Requested a response size of " << responseSize;
-                gPushResponseBody = std::string(responseSize, 'a');
+            }
+            if (responseSize > params.pushMaxBytes)
+            {
+                VLOG(2) << "Clamping the response size to " << params.pushMaxBytes;
+                responseSize = params.pushMaxBytes;
             }
         }
 
@@ -277,6 +428,7 @@ namespace quic::samples
                 LOG(ERROR) << "Could not create push transaction: stop pushing";
                 break;
             }
+            ++pendingPushes;
 
             proxygen::WebTransport* webTransport = pushedTransaction->getWebTransport();
             webTransport->awaitBidiStreamCredit();
@@ -285,15 +437,16 @@ namespace quic::samples
             sendPushPromise(pushedTransaction, pushedResourceUrl);
 
             // Send the push response
-            sendPushResponse(pushedTransaction, pushedResourceUrl, gPushResponseBody, true);
+            sendPushResponse(pushedTransaction, pushedResourceUrl, responseSize, true);
         }
 
         // Send the response to the original get request
-        sendOkResponse("I AM THE REQUEST RESPONSE AND I AM RESPONSIBLE", true);
+        sendOkResponse(ResponseBody::PUSH_REQUEST_RESPONSE, true);
     }
 
     void ServerPushHandler::onBody(std::unique_ptr<folly::IOBuf> chain) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::PUSH, LoopStats::Phase::READ);
         VLOG(10) << "ServerPushHandler::" << __func__ << " - ignoring";
     }
 
@@ -324,18 +477,18 @@ namespace quic::samples
                        .count();
     }
 
-    void ServerPushHandler::sendErrorResponse(const std::string& body)
+    void ServerPushHandler::sendErrorResponse(ResponseBody body)
     {
         proxygen::HTTPMessage resp = createHttpResponse(400, "ERROR");
         resp.setWantsKeepalive(false);
         transaction->sendHeaders(resp);
-        transaction->sendBody(folly::IOBuf::copyBuffer(body));
+        transaction->sendBody(ResponseBodyCache::get(body));
         transaction->sendEOM();
     }
 
     void ServerPushHandler::sendPushResponse(proxygen::HTTPTransaction* pushTransaction,
                                              const std::string& pushedResourceUrl,
-                                             const std::string& pushedResourceBody,
+                                             size_t pushedResourceSize,
                                              bool eom)
     {
         VLOG(10) << "ServerPushHandler::" << __func__;
@@ -344,10 +497,11 @@ namespace quic::samples
         response.setIsChunked(true);
         pushTransaction->sendHeaders(response);
 
-        std::string responseStr =
-            "I AM THE PUSHED RESPONSE AND I AM NOT RESPONSIBLE: " + pushedResourceBody;
+        // Shared prefix followed by references into the padding slab, nothing is copied
+        auto responseBody = ResponseBodyCache::get(ResponseBody::PUSH_RESPONSE_PREFIX);
+        PaddingSlab::append(*responseBody, pushedResourceSize);
 
-        pushTransaction->sendBody(folly::IOBuf::copyBuffer(responseStr));
+        pushTransaction->sendBody(std::move(responseBody));
 
         VLOG(2) << "Sent push response for " << pushedResourceUrl << " at: "
                 << std::chrono::duration_cast<std::chrono::microseconds>(
@@ -364,14 +518,15 @@ namespace quic::samples
         }
     }
 
-    void ServerPushHandler::sendOkResponse(const std::string& body, bool eom)
+    void ServerPushHandler::sendOkResponse(ResponseBody body, bool eom)
     {
-        VLOG(10) << "ServerPushHandler::" << __func__ << ": sending " << body.length() << " bytes";
+        VLOG(10) << "ServerPushHandler::" << __func__ << ": sending "
+                 << ResponseBodyCache::view(body).size() << " bytes";
         proxygen::HTTPMessage resp = createHttpResponse(200, "OK");
         resp.setWantsKeepalive(true);
         resp.setIsChunked(true);
         transaction->sendHeaders(resp);
-        transaction->sendBody(folly::IOBuf::copyBuffer(body));
+        transaction->sendBody(ResponseBodyCache::get(body));
         if (eom)
         {
             transaction->sendEOM();
@@ -380,6 +535,7 @@ namespace quic::samples
 
     void TestHandler::onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::READ);
         VLOG(10) << "WebtransportHandler::" << __func__;
         message->dumpMessage(2);
 
@@ -408,6 +564,10 @@ namespace quic::samples
         if (webTransport)
         {
             status = 200;
+            if (params.datagramBatchMaxQueued > 0)
+            {
+                datagramBatcher.emplace(eventBase, webTransport, params.datagramBatchMaxQueued);
+            }
         }
 
         // Send the response to the original get request
@@ -429,36 +589,158 @@ namespace quic::samples
         transaction->sendHeaders(response);
     }
 
+    /**
+     * Echo state of one WebTransport stream. Every non-empty or FIN write registers
+     * this object as its delivery callback. It deletes itself once the read side is
+     * done (FIN read, error or abort(), so no read or awaitWritable continuation
+     * holds it) and no delivery callback is outstanding.
+     */
+    class TestHandler::EchoStream : public proxygen::WebTransport::ByteEventCallback
+    {
+    public:
+        explicit EchoStream(proxygen::WebTransport::StreamWriteHandle* handle) :
+            writeHandle(handle), startTime(std::chrono::steady_clock::now())
+        {
+        }
+
+        folly::Expected<proxygen::WebTransport::FCState, proxygen::WebTransport::ErrorCode> write(
+            std::unique_ptr<folly::IOBuf> data,
+            bool fin)
+        {
+            auto length = data ? data->computeChainDataLength() : 0;
+            bytesEchoed += length;
+            // An empty write without FIN registers no byte event
+            bool tracked  = length > 0 || fin;
+            auto callback = tracked ? this : nullptr;
+            auto result   = writeHandle->writeStreamData(std::move(data), fin, callback);
+            if (result.hasValue())
+            {
+                pendingDeliveries += tracked ? 1 : 0;
+                finSent = fin;
+            }
+            return result;
+        }
+
+        // The peer reset the stream or sent STOP_SENDING, writeHandle is gone
+        [[nodiscard]] bool isWriteClosed() const
+        {
+            return aborted;
+        }
+
+        // Called when the read side stops without an error, after the FIN or once the
+        // write side is closed
+        void finishRead()
+        {
+            readDone = true;
+            maybeDestroy();
+        }
+
+        void abort(uint32_t error)
+        {
+            readDone = true;
+            if (!aborted)
+            {
+                aborted = true;
+                // resetStream can cancel outstanding deliveries synchronously; hold an
+                // extra count so that does not destroy this object underneath us
+                ++pendingDeliveries;
+                writeHandle->resetStream(error);
+                --pendingDeliveries;
+            }
+            maybeDestroy();
+        }
+
+        void onByteEvent(quic::StreamId id, uint64_t offset) noexcept override
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (!firstByteDelivered)
+            {
+                firstByteDelivered = true;
+                VLOG(2) << "Echo stream=" << id << " first delivery after "
+                        << std::chrono::duration_cast<std::chrono::microseconds>(now - startTime)
+                               .count()
+                        << "us";
+            }
+            --pendingDeliveries;
+            if (finSent && pendingDeliveries == 0)
+            {
+                auto elapsed =
+                    std::chrono::duration_cast<std::chrono::microseconds>(now - startTime);
+                VLOG(1) << "Echo stream=" << id << " delivered " << bytesEchoed << " bytes in "
+                        << elapsed.count() << "us";
+            }
+            maybeDestroy();
+        }
+
+        void onByteEventCanceled(quic::StreamId id, uint64_t offset) noexcept override
+        {
+            VLOG(4) << "Echo stream=" << id << " delivery canceled at offset=" << offset;
+            --pendingDeliveries;
+            aborted = true;
+            maybeDestroy();
+        }
+
+        proxygen::WebTransport::StreamWriteHandle* writeHandle = nullptr;
+
+    private:
+        void maybeDestroy()
+        {
+            if (readDone && pendingDeliveries == 0)
+            {
+                delete this;
+            }
+        }
+
+        std::chrono::steady_clock::time_point startTime;
+        uint64_t bytesEchoed     = 0;
+        size_t pendingDeliveries = 0;
+        bool firstByteDelivered  = false;
+        bool finSent             = false;
+        bool aborted             = false;
+        bool readDone            = false;
+    };
+
     void TestHandler::onWebTransportBidiStream(
         proxygen::HTTPCodec::StreamID id,
         proxygen::WebTransport::BidiStreamHandle stream) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::READ);
         VLOG(4) << "New Bidi Stream=" << id;
-        stream.readHandle->awaitNextRead(
-            eventBase,
-            [this, stream](auto readHandle, auto streamData)
-            {
-                readHandler(stream.writeHandle, readHandle, std::move(streamData));
-            });
+        SAMPLE_TRACE(stream_open, id, 1);
+        startEcho(stream.writeHandle, stream.readHandle);
     }
 
     void TestHandler::onWebTransportUniStream(
         proxygen::HTTPCodec::StreamID id,
         proxygen::WebTransport::StreamReadHandle* readHandle) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::READ);
         VLOG(4) << "New Uni Stream=" << id;
+        SAMPLE_TRACE(stream_open, id, 0);
         auto webTransport        = transaction->getWebTransport();
         auto writeHandleExpected = webTransport->createUniStream();
         if (writeHandleExpected.hasError())
         {
             LOG(ERROR) << "Create Unistream Error!";
+            readHandle->stopSending(0);
             return;
         }
-        auto writeHandle = writeHandleExpected.value();
+        startEcho(writeHandleExpected.value(), readHandle);
+    }
+
+    void TestHandler::startEcho(proxygen::WebTransport::StreamWriteHandle* writeHandle,
+                                proxygen::WebTransport::StreamReadHandle* readHandle)
+    {
+        awaitNextRead(new EchoStream(writeHandle), readHandle);
+    }
+
+    void TestHandler::awaitNextRead(EchoStream* stream,
+                                    proxygen::WebTransport::StreamReadHandle* readHandle)
+    {
         readHandle->awaitNextRead(eventBase,
-                                  [this, writeHandle](auto readHandle, auto streamData)
+                                  [this, stream](auto readHandle, auto streamData)
                                   {
-                                      readHandler(writeHandle, readHandle, std::move(streamData));
+                                      readHandler(stream, readHandle, std::move(streamData));
                                   });
     }
 
@@ -466,17 +748,30 @@ namespace quic::samples
     {
         VLOG(4) << "Session Close error="
                 << (error ? folly::to<std::string>(*error) : std::string("none"));
+        if (datagramBatcher)
+        {
+            datagramBatcher->clear();
+        }
     }
 
     void TestHandler::onDatagram(std::unique_ptr<folly::IOBuf> datagram) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::READ);
         VLOG(4) << "TestHandler::" << __func__;
+        SAMPLE_TRACE(datagram_recv, datagram->computeChainDataLength());
+        if (datagramBatcher)
+        {
+            datagramBatcher->enqueue(std::move(datagram));
+            return;
+        }
         auto webTransport = transaction->getWebTransport();
-        webTransport->sendDatagram(datagram->clone());
+        SAMPLE_TRACE(datagram_send, datagram->computeChainDataLength());
+        webTransport->sendDatagram(std::move(datagram));
     }
 
     void TestHandler::onBody(std::unique_ptr<folly::IOBuf> body) noexcept
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::READ);
         VLOG(4) << "TestHandler::" << __func__;
         VLOG(3) << proxygen::IOBufPrinter::printHexFolly(body.get(), true);
     }
@@ -493,35 +788,77 @@ namespace quic::samples
     void TestHandler::onError(const proxygen::HTTPException& error) noexcept
     {
         VLOG(4) << "TestHandler::onError error=" << error.what();
+        if (datagramBatcher)
+        {
+            datagramBatcher->clear();
+        }
     }
 
-    void TestHandler::readHandler(proxygen::WebTransport::StreamWriteHandle* writeHandle,
+    void TestHandler::readHandler(EchoStream* stream,
                                   proxygen::WebTransport::StreamReadHandle* readHandle,
                                   folly::Try<proxygen::WebTransport::StreamData> streamData)
     {
+        LoopStats::CallbackTimer timer(LoopStats::Handler::TEST, LoopStats::Phase::READ);
         if (streamData.hasException())
         {
             VLOG(4) << "read error=" << streamData.exception().what();
+            SAMPLE_TRACE(stream_close, readHandle->getID(), 1);
+            stream->abort(0);
+            return;
         }
-        else
+
+        if (stream->isWriteClosed())
         {
-            VLOG(4) << "read data id =" << readHandle->getID();
+            VLOG(4) << "write side closed id =" << readHandle->getID();
+            readHandle->stopSending(0);
+            stream->finishRead();
+            return;
+        }
 
-            if (!streamData->fin)
-            {
-                readHandle->awaitNextRead(
-                    eventBase,
-                    [this, writeHandle](auto readHandle, auto streamData)
-                    {
-                        readHandler(writeHandle, readHandle, std::move(streamData));
-                    });
-            }
-            else
-            {
-                LOG(INFO) << "read finish!";
-                writeHandle->writeStreamData(std::move(streamData->data), true, nullptr);
-                LOG(INFO) << "write finish!";
-            }
+        VLOG(4) << "read data id =" << readHandle->getID();
+        auto fin    = streamData->fin;
+        auto result = stream->write(std::move(streamData->data), fin);
+        if (result.hasError())
+        {
+            VLOG(4) << "write error id =" << stream->writeHandle->getID();
+            readHandle->stopSending(0);
+            stream->abort(0);
+            return;
         }
+        if (fin)
+        {
+            SAMPLE_TRACE(stream_close, readHandle->getID(), 0);
+            stream->finishRead();
+            return;
+        }
+
+        if (result.value() != proxygen::WebTransport::FCState::BLOCKED)
+        {
+            awaitNextRead(stream, readHandle);
+            return;
+        }
+
+        // Stop reading until the peer grants more credit on the write side
+        auto writable = stream->writeHandle->awaitWritable();
+        if (writable.hasError())
+        {
+            readHandle->stopSending(0);
+            stream->abort(0);
+            return;
+        }
+        std::move(writable.value())
+            .via(folly::getKeepAliveToken(eventBase))
+            .thenTry(
+                [this, stream, readHandle](folly::Try<uint64_t> writableBytes)
+                {
+                    if (writableBytes.hasException())
+                    {
+                        VLOG(4) << "awaitWritable error=" << writableBytes.exception().what();
+                        readHandle->stopSending(0);
+                        stream->abort(0);
+                        return;
+                    }
+                    awaitNextRead(stream, readHandle);
+                });
     }
 }  // namespace quic::samples
@@ -1,16 +1,19 @@
 #pragma once
 
 #include <folly/Conv.h>
+#include <folly/container/F14Map.h>
 #include <folly/futures/Future.h>
 #include <folly/io/IOBuf.h>
 #include <proxygen/lib/http/HTTPException.h>
 #include <proxygen/lib/http/HTTPMessage.h>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <climits>
 #include <cmath>
 #include <functional>
 #include <mutex>
+#include <optional>
 #include <random>
 #include <vector>
 
@@ -19,15 +22,24 @@
 #include <folly/Format.h>
 #include <folly/Memory.h>
 #include <folly/Random.h>
+#include <folly/Synchronized.h>
 #include <folly/ThreadLocal.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBaseLocal.h>
 #include <folly/io/async/EventBaseManager.h>
 #include <proxygen/lib/http/session/HTTPTransaction.h>
 #include <proxygen/lib/utils/SafePathUtils.h>
 
+#include "DatagramBatcher.h"
 #include "DeviousBaton.h"
 #include "HQServer.h"
+#include "HandlerPool.h"
+#include "LoopLagMonitor.h"
+#include "LoopStats.h"
+#include "ResponseBodyCache.h"
+#include "RouteTable.h"
+#include "Tracepoints.h"
 
 namespace quic::samples
 {
@@ -40,6 +52,12 @@ namespace quic::samples
         std::string protocol;
         uint16_t port;
         std::string httpVersion;
+        // Unacknowledged bytes EchoHandler may echo before pausing ingress, 0 = unlimited
+        uint64_t echoMaxInflightBytes = 0;
+        // Datagrams TestHandler queues per loop iteration, 0 = no batching
+        uint32_t datagramBatchMaxQueued = 0;
+        // Cap on the pushed body size a request can ask for
+        uint64_t pushMaxBytes = 0;
 
         HandlerParams(std::string proto, uint16_t po, std::string version) :
             protocol(proto), port(po), httpVersion(version)
@@ -50,12 +68,28 @@ namespace quic::samples
     class Dispatcher
     {
     public:
-        explicit Dispatcher(HandlerParams handlerParams) : params(std::move(handlerParams)) {}
+        explicit Dispatcher(HandlerParams handlerParams);
+
+        Dispatcher(const Dispatcher&)            = delete;
+        Dispatcher& operator=(const Dispatcher&) = delete;
 
         proxygen::HTTPTransactionHandler* getRequestHandler(proxygen::HTTPMessage* message);
 
+        [[nodiscard]] const RouteTable& getRoutes() const noexcept
+        {
+            return routes;
+        }
+
     private:
+        // Whether the request may get a 503 while its worker sheds load
+        [[nodiscard]] bool isLowPriority(const proxygen::HTTPMessage& message,
+                                         size_t routeId) const;
+
         HandlerParams params;
+        // Built once in the constructor, read-only afterwards
+        RouteTable routes;
+        // Indexed by route id
+        std::vector<bool> sheddableRoutes;
     };
 
     class BaseSampleHandler : public proxygen::HTTPTransactionHandler
@@ -67,12 +101,34 @@ namespace quic::samples
 
         void setTransaction(proxygen::HTTPTransaction* txn) noexcept override
         {
+            SAMPLE_TRACE(handler_attach, this, txn ? txn->getID() : 0);
             transaction = txn;
         }
 
         void detachTransaction() noexcept override
         {
-            delete this;
+            SAMPLE_TRACE(handler_detach, this);
+            transaction = nullptr;
+            if (recycler)
+            {
+                recycler->recycle(this);
+            }
+            else
+            {
+                delete this;
+            }
+        }
+
+        // Pooled handlers are handed back to the recycler instead of being deleted
+        void setRecycler(HandlerRecycler* handlerRecycler) noexcept
+        {
+            recycler = handlerRecycler;
+        }
+
+        // Clears per-request state before a pooled handler is reused
+        virtual void reset() noexcept
+        {
+            transaction = nullptr;
         }
 
         void onChunkHeader(size_t /*length*/) noexcept override {}
@@ -97,16 +153,9 @@ namespace quic::samples
                                  fmt::format("{}=\":{}\"; ma=3600", params.protocol, params.port));
         }
 
-        static const std::string& getH1QFooter()
+        static std::unique_ptr<folly::IOBuf> getH1QFooter()
         {
-            // clang-format off
-            static const std::string footer(
-                "==============\n"
-                " Hello World! \n"
-                "==============\n"
-            );
-            // clang-format on
-            return footer;
+            return ResponseBodyCache::get(ResponseBody::H1Q_FOOTER);
         }
 
         static uint32_t getQueryParamAsNumber(std::unique_ptr<proxygen::HTTPMessage>& msg,
@@ -133,12 +182,23 @@ namespace quic::samples
 
         proxygen::HTTPTransaction* transaction = nullptr;
         const HandlerParams& params;
+        HandlerRecycler* recycler = nullptr;
     };
 
     using random_bytes_engine =
         std::independent_bits_engine<std::default_random_engine, CHAR_BIT, unsigned char>;
 
-    class EchoHandler : public BaseSampleHandler
+    /**
+     * Echoes the request body back, passing each received IOBuf chain straight to
+     * sendBody. Ingress is paused while egress is paused, or while more than
+     * echoMaxInflightBytes of echoed body have not been acknowledged by the peer, so
+     * a fast uploader cannot pile up unbounded egress buffers in the session.
+     * Transports without delivery events (HTTP/1.1, HTTP/2) fall back to the egress
+     * pause alone.
+     */
+    class EchoHandler :
+        public BaseSampleHandler,
+        private proxygen::HTTPTransaction::TransportCallback
     {
     public:
         explicit EchoHandler(const HandlerParams& params) : BaseSampleHandler(params) {}
@@ -147,6 +207,7 @@ namespace quic::samples
 
         void onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept override
         {
+            LoopStats::CallbackTimer timer(LoopStats::Handler::ECHO, LoopStats::Phase::READ);
             VLOG(10) << "EchoHandler::onHeadersComplete";
             proxygen::HTTPMessage response;
             VLOG(10) << "Seting http-version to " << getHttpVersion();
@@ -166,22 +227,62 @@ namespace quic::samples
 
             maybeAddAltSvcHeader(response);
 
+            if (params.echoMaxInflightBytes > 0)
+            {
+                transaction->setTransportCallback(this);
+            }
             transaction->sendHeaders(response);
         }
 
         void onBody(std::unique_ptr<folly::IOBuf> chain) noexcept override
         {
+            LoopStats::CallbackTimer timer(LoopStats::Handler::ECHO, LoopStats::Phase::READ);
             VLOG(10) << "EchoHandler::onBody";
+            auto length = chain->computeChainDataLength();
+            if (length == 0)
+            {
+                return;
+            }
             transaction->sendBody(std::move(chain));
+            egressOffset += length;
+            if (params.echoMaxInflightBytes == 0)
+            {
+                return;
+            }
+            // Only the last byte of the chunk is tracked, its delivery implies the rest
+            if (!transaction->trackEgressBodyOffset(egressOffset - 1,
+                                                    proxygen::ByteEvent::EventFlags::ACK))
+            {
+                ackedOffset = egressOffset;
+            }
+            if (egressOffset - ackedOffset >= params.echoMaxInflightBytes)
+            {
+                pauseIngress();
+            }
+        }
+
+        void onEgressPaused() noexcept override
+        {
+            VLOG(10) << "EchoHandler::onEgressPaused";
+            egressPaused = true;
+            pauseIngress();
+        }
+
+        void onEgressResumed() noexcept override
+        {
+            LoopStats::CallbackTimer timer(LoopStats::Handler::ECHO, LoopStats::Phase::WRITE);
+            VLOG(10) << "EchoHandler::onEgressResumed";
+            egressPaused = false;
+            maybeResumeIngress();
         }
 
         void onEOM() noexcept override
         {
+            LoopStats::CallbackTimer timer(LoopStats::Handler::ECHO, LoopStats::Phase::READ);
             VLOG(10) << "EchoHandler::onEOM";
             if (sendFooter)
             {
-                auto& footer = getH1QFooter();
-                transaction->sendBody(folly::IOBuf::copyBuffer(footer.data(), footer.length()));
+                transaction->sendBody(getH1QFooter());
             }
             transaction->sendEOM();
         }
@@ -191,17 +292,79 @@ namespace quic::samples
             transaction->sendAbort();
         }
 
+        void detachTransaction() noexcept override
+        {
+            if (transaction)
+            {
+                transaction->setTransportCallback(nullptr);
+            }
+            BaseSampleHandler::detachTransaction();
+        }
+
+        void reset() noexcept override
+        {
+            BaseSampleHandler::reset();
+            sendFooter    = false;
+            egressPaused  = false;
+            ingressPaused = false;
+            egressOffset  = 0;
+            ackedOffset   = 0;
+        }
+
     private:
-        bool sendFooter = false;
+        // TransportCallback, only delivery events are of interest
+        void bodyBytesDelivered(uint64_t bodyOffset) noexcept override
+        {
+            LoopStats::CallbackTimer timer(LoopStats::Handler::ECHO, LoopStats::Phase::WRITE);
+            ackedOffset = std::max(ackedOffset, bodyOffset + 1);
+            if (transaction)
+            {
+                maybeResumeIngress();
+            }
+        }
+
+        void firstHeaderByteFlushed() noexcept override {}
+        void firstByteFlushed() noexcept override {}
+        void lastByteFlushed() noexcept override {}
+        void lastByteAcked(std::chrono::milliseconds /*latency*/) noexcept override {}
+        void headerBytesGenerated(proxygen::HTTPHeaderSize& /*size*/) noexcept override {}
+        void headerBytesReceived(const proxygen::HTTPHeaderSize& /*size*/) noexcept override {}
+        void bodyBytesGenerated(size_t /*nbytes*/) noexcept override {}
+        void bodyBytesReceived(size_t /*size*/) noexcept override {}
+
+        void pauseIngress()
+        {
+            if (!ingressPaused)
+            {
+                ingressPaused = true;
+                transaction->pauseIngress();
+            }
+        }
+
+        void maybeResumeIngress()
+        {
+            if (ingressPaused && !egressPaused
+                && (params.echoMaxInflightBytes == 0
+                    || egressOffset - ackedOffset < params.echoMaxInflightBytes))
+            {
+                ingressPaused = false;
+                // may synchronously deliver buffered body through onBody()
+                transaction->resumeIngress();
+            }
+        }
+
+        bool sendFooter       = false;
+        bool egressPaused     = false;
+        bool ingressPaused    = false;
+        // Body bytes echoed, and the prefix of them the peer has acknowledged
+        uint64_t egressOffset = 0;
+        uint64_t ackedOffset  = 0;
     };
 
     class DeviousBatonHandler : public BaseSampleHandler
     {
     public:
-        explicit DeviousBatonHandler(const HandlerParams& params, folly::EventBase* evb) :
-            BaseSampleHandler(params), eventBase(evb)
-        {
-        }
+        explicit DeviousBatonHandler(const HandlerParams& params, folly::EventBase* evb);
 
         void onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept override;
 
@@ -223,14 +386,43 @@ namespace quic::samples
 
         void onError(const proxygen::HTTPException& error) noexcept override;
 
-        void detachTransaction() noexcept override {}
+        void detachTransaction() noexcept override
+        {
+            SAMPLE_TRACE(handler_detach, this);
+        }
 
         void readHandler(proxygen::WebTransport::StreamReadHandle* readHandle,
                          folly::Try<proxygen::WebTransport::StreamData> streamData);
 
+        // Parser states currently held by all sessions of the process
+        static uint64_t getLiveStreamStates();
+
         folly::Optional<devious::DeviousBaton> devious;
         folly::EventBase* eventBase = nullptr;
-        std::map<uint64_t, devious::DeviousBaton::BatonMessageState> streams;
+
+    private:
+        // Parser states held by the sessions of one worker, summed across workers on read
+        struct WorkerStreamStates
+        {
+            WorkerStreamStates();
+            ~WorkerStreamStates();
+
+            std::atomic<uint64_t> live {0};
+        };
+
+        devious::DeviousBaton::BatonMessageState& getStreamState(uint64_t id);
+
+        void releaseStreamState(uint64_t id);
+
+        void releaseAllStreamStates();
+
+        static inline folly::EventBaseLocal<WorkerStreamStates> localStreamStates;
+        static inline folly::Synchronized<std::vector<WorkerStreamStates*>> allStreamStates;
+
+        WorkerStreamStates& liveStreamStates;
+
+        // Only streams with a message in progress have an entry
+        folly::F14FastMap<uint64_t, devious::DeviousBaton::BatonMessageState> streams;
     };
 
     class DummyHandler : public BaseSampleHandler
@@ -256,14 +448,14 @@ namespace quic::samples
             transaction->sendHeaders(response);
             if (message->getMethod() == proxygen::HTTPMethod::GET)
             {
-                transaction->sendBody(folly::IOBuf::copyBuffer(kDummyMessage));
+                transaction->sendBody(ResponseBodyCache::get(ResponseBody::DUMMY));
             }
         }
 
         void onBody(std::unique_ptr<folly::IOBuf> /* chain */) noexcept override
         {
             VLOG(10) << "DummyHandler::onBody";
-            transaction->sendBody(folly::IOBuf::copyBuffer(kDummyMessage));
+            transaction->sendBody(ResponseBodyCache::get(ResponseBody::DUMMY));
         }
 
         void onEOM() noexcept override
@@ -272,13 +464,65 @@ namespace quic::samples
             transaction->sendEOM();
         }
 
+        void onError(const proxygen::HTTPException& /* error */) noexcept override
+        {
+            transaction->sendAbort();
+        }
+    };
+
+    // Answers requests shed under overload with a 503
+    class OverloadedHandler : public BaseSampleHandler
+    {
+    public:
+        explicit OverloadedHandler(const HandlerParams& params) : BaseSampleHandler(params) {}
+
+        OverloadedHandler() = delete;
+
+        void onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage>) noexcept override
+        {
+            proxygen::HTTPMessage response;
+            response.setVersionString(getHttpVersion());
+            response.setStatusCode(503);
+            response.setStatusMessage("Service Unavailable");
+            response.getHeaders().add(proxygen::HTTP_HEADER_RETRY_AFTER, "1");
+            transaction->sendHeaders(response);
+            transaction->sendEOM();
+        }
+
+        void onBody(std::unique_ptr<folly::IOBuf> /* chain */) noexcept override {}
+
+        void onEOM() noexcept override {}
+
+        void onError(const proxygen::HTTPException& /* error */) noexcept override
+        {
+            transaction->sendAbort();
+        }
+    };
+
+    // Serves renderMetrics() for Prometheus scrapes
+    class MetricsHandler : public BaseSampleHandler
+    {
+    public:
+        MetricsHandler(const HandlerParams& params, const RouteTable& routeTable) :
+            BaseSampleHandler(params), routes(routeTable)
+        {
+        }
+
+        MetricsHandler() = delete;
+
+        void onHeadersComplete(std::unique_ptr<proxygen::HTTPMessage> message) noexcept override;
+
+        void onBody(std::unique_ptr<folly::IOBuf> /* chain */) noexcept override {}
+
+        void onEOM() noexcept override {}
+
         void onError(const proxygen::HTTPException& /* error */) noexcept override
         {
             transaction->sendAbort();
         }
 
     private:
-        const std::string kDummyMessage = folly::to<std::string>("Undefined path...");
+        const RouteTable& routes;
     };
 
     namespace
@@ -288,17 +532,30 @@ namespace quic::samples
 
     class ServerPushHandler : public BaseSampleHandler
     {
+        // Shared by all pushed transactions of one request
         class ServerPushTransactionHandler : public proxygen::HTTPPushTransactionHandler
         {
+        public:
+            explicit ServerPushTransactionHandler(ServerPushHandler& pushHandler) :
+                parent(pushHandler)
+            {
+            }
+
             void setTransaction(proxygen::HTTPTransaction* trans) noexcept override {}
 
-            void detachTransaction() noexcept override {}
+            void detachTransaction() noexcept override
+            {
+                parent.onPushDetached();
+            }
 
             void onError(const proxygen::HTTPException& error) noexcept override {}
 
             void onEgressPaused() noexcept override {}
 
             void onEgressResumed() noexcept override {}
+
+        private:
+            ServerPushHandler& parent;
         };
 
     public:
@@ -312,22 +569,53 @@ namespace quic::samples
 
         void onEOM() noexcept override;
 
-        void detachTransaction() noexcept override {}
+        // Pushed transactions can outlive the request, so the handler is only released
+        // once all of them are detached as well
+        void detachTransaction() noexcept override
+        {
+            requestDetached = true;
+            maybeRelease();
+        }
+
+        void reset() noexcept override
+        {
+            BaseSampleHandler::reset();
+            path.clear();
+            pendingPushes   = 0;
+            requestDetached = false;
+        }
 
     private:
+        void onPushDetached() noexcept
+        {
+            DCHECK_GT(pendingPushes, 0);
+            --pendingPushes;
+            maybeRelease();
+        }
+
+        void maybeRelease() noexcept
+        {
+            if (requestDetached && pendingPushes == 0)
+            {
+                BaseSampleHandler::detachTransaction();
+            }
+        }
+
         void sendPushPromise(proxygen::HTTPTransaction* pushTransaction, const std::string& path);
 
-        void sendErrorResponse(const std::string& body);
+        void sendErrorResponse(ResponseBody body);
 
         void sendPushResponse(proxygen::HTTPTransaction* pushTransaction,
                               const std::string& url,
-                              const std::string& body,
+                              size_t bodySize,
                               bool eom);
 
-        void sendOkResponse(const std::string& body, bool eom);
+        void sendOkResponse(ResponseBody body, bool eom);
 
         std::string path;
-        ServerPushTransactionHandler pushTransactionHandler;
+        ServerPushTransactionHandler pushTransactionHandler {*this};
+        size_t pendingPushes = 0;
+        bool requestDetached = false;
     };
 
     class TestHandler : public BaseSampleHandler
@@ -358,12 +646,31 @@ namespace quic::samples
 
         void onError(const proxygen::HTTPException& error) noexcept override;
 
-        void detachTransaction() noexcept override {}
+        void detachTransaction() noexcept override
+        {
+            SAMPLE_TRACE(handler_detach, this);
+            // The queued datagrams and the flush refer to the session's WebTransport,
+            // destroying the batcher drops them
+            datagramBatcher.reset();
+        }
+
+        class EchoStream;
 
-        void readHandler(proxygen::WebTransport::StreamWriteHandle* writeHandle,
+        // Writes every chunk as soon as it is read, and only asks for the next one
+        // once the write side has flow control credit again
+        void readHandler(EchoStream* stream,
                          proxygen::WebTransport::StreamReadHandle* readHandle,
                          folly::Try<proxygen::WebTransport::StreamData> streamData);
 
         folly::EventBase* eventBase = nullptr;
+
+    private:
+        std::optional<DatagramBatcher> datagramBatcher;
+
+        void startEcho(proxygen::WebTransport::StreamWriteHandle* writeHandle,
+                       proxygen::WebTransport::StreamReadHandle* readHandle);
+
+        void awaitNextRead(EchoStream* stream,
+                           proxygen::WebTransport::StreamReadHandle* readHandle);
     };
 }  // namespace quic::samples
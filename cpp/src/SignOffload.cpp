@@ -0,0 +1,93 @@
+#include "SignOffload.h"
+
+#include <folly/ScopeGuard.h>
+#include <folly/futures/Future.h>
+#include <chrono>
+
+namespace
+{
+    uint64_t toMicros(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    OffloadSelfCert::OffloadSelfCert(std::shared_ptr<fizz::SelfCert> selfCert,
+                                     std::shared_ptr<folly::CPUThreadPoolExecutor> signExecutor) :
+        cert(std::move(selfCert)), executor(std::move(signExecutor))
+    {
+    }
+
+    std::string OffloadSelfCert::getIdentity() const
+    {
+        return cert->getIdentity();
+    }
+
+    std::vector<std::string> OffloadSelfCert::getAltIdentities() const
+    {
+        return cert->getAltIdentities();
+    }
+
+    std::vector<fizz::SignatureScheme> OffloadSelfCert::getSigSchemes() const
+    {
+        return cert->getSigSchemes();
+    }
+
+    fizz::CertificateMsg OffloadSelfCert::getCertMessage(fizz::Buf certificateRequestContext) const
+    {
+        return cert->getCertMessage(std::move(certificateRequestContext));
+    }
+
+    fizz::CompressedCertificate OffloadSelfCert::getCompressedCert(
+        fizz::CertificateCompressionAlgorithm algo) const
+    {
+        return cert->getCompressedCert(algo);
+    }
+
+    fizz::Buf OffloadSelfCert::sign(fizz::SignatureScheme scheme,
+                                    fizz::CertificateVerifyContext context,
+                                    folly::ByteRange toBeSigned) const
+    {
+        return cert->sign(scheme, context, toBeSigned);
+    }
+
+    folly::SemiFuture<folly::Optional<fizz::Buf>> OffloadSelfCert::signFuture(
+        fizz::SignatureScheme scheme,
+        fizz::CertificateVerifyContext context,
+        std::unique_ptr<folly::IOBuf> toBeSigned) const
+    {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        return folly::via(folly::getKeepAliveToken(executor.get()),
+                          [cert = cert,
+                           scheme,
+                           context,
+                           toBeSigned = std::move(toBeSigned),
+                           enqueued = std::chrono::steady_clock::now()]() mutable
+                          {
+                              auto start = std::chrono::steady_clock::now();
+                              SCOPE_EXIT
+                              {
+                                  pending.fetch_sub(1, std::memory_order_relaxed);
+                                  auto done   = std::chrono::steady_clock::now();
+                                  auto locked = histograms.lock();
+                                  locked->queueUs.add(toMicros(start - enqueued));
+                                  locked->signUs.add(toMicros(done - start));
+                              };
+                              return folly::Optional<fizz::Buf>(
+                                  cert->sign(scheme, context, toBeSigned->coalesce()));
+                          })
+            .semi();
+    }
+
+    SignOffloadStats OffloadSelfCert::getStats()
+    {
+        auto locked = histograms.lock();
+        return {
+            .pending = pending.load(std::memory_order_relaxed),
+            .queueUs = locked->queueUs.snapshot(),
+            .signUs  = locked->signUs.snapshot(),
+        };
+    }
+}  // namespace quic::samples
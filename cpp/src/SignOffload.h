@@ -0,0 +1,73 @@
+#pragma once
+
+#include <fizz/protocol/AsyncSelfCert.h>
+#include <folly/Synchronized.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "LoopStats.h"
+
+namespace quic::samples
+{
+    struct SignOffloadStats
+    {
+        // Signatures queued or running on the pool
+        uint64_t pending = 0;
+        Log2Histogram::Snapshot queueUs;
+        Log2Histogram::Snapshot signUs;
+    };
+
+    /**
+     * Signs CertificateVerify on a thread pool instead of the QUIC worker.
+     *
+     * fizz sees an AsyncSelfCert, waits on signFuture() and continues the handshake
+     * on the worker's EventBase once the signature is ready, so an RSA signature no
+     * longer stalls the other connections of that worker.
+     */
+    class OffloadSelfCert : public fizz::AsyncSelfCert
+    {
+    public:
+        OffloadSelfCert(std::shared_ptr<fizz::SelfCert> cert,
+                        std::shared_ptr<folly::CPUThreadPoolExecutor> executor);
+
+        std::string getIdentity() const override;
+
+        std::vector<std::string> getAltIdentities() const override;
+
+        std::vector<fizz::SignatureScheme> getSigSchemes() const override;
+
+        fizz::CertificateMsg getCertMessage(
+            fizz::Buf certificateRequestContext = nullptr) const override;
+
+        fizz::CompressedCertificate getCompressedCert(
+            fizz::CertificateCompressionAlgorithm algo) const override;
+
+        // Inline signing, only used by callers unaware of AsyncSelfCert
+        fizz::Buf sign(fizz::SignatureScheme scheme,
+                       fizz::CertificateVerifyContext context,
+                       folly::ByteRange toBeSigned) const override;
+
+        folly::SemiFuture<folly::Optional<fizz::Buf>> signFuture(
+            fizz::SignatureScheme scheme,
+            fizz::CertificateVerifyContext context,
+            std::unique_ptr<folly::IOBuf> toBeSigned) const override;
+
+        static SignOffloadStats getStats();
+
+    private:
+        // Pool threads write concurrently, Log2Histogram expects a single writer
+        struct Histograms
+        {
+            Log2Histogram queueUs;
+            Log2Histogram signUs;
+        };
+
+        std::shared_ptr<fizz::SelfCert> cert;
+        std::shared_ptr<folly::CPUThreadPoolExecutor> executor;
+
+        static inline std::atomic<uint64_t> pending {0};
+        static inline folly::Synchronized<Histograms, std::mutex> histograms;
+    };
+}  // namespace quic::samples
@@ -0,0 +1,268 @@
+#include "Takeover.h"
+
+#include <folly/FileUtil.h>
+#include <glog/logging.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+    using namespace quic::samples;
+
+    constexpr uint32_t kTakeoverVersion = 1;
+    constexpr size_t kMaxTakeoverFds    = 64;
+    constexpr int kTakeoverTimeoutSec   = 5;
+
+    struct TakeoverHeader
+    {
+        uint32_t version;
+        uint32_t numFds;
+        uint8_t processId;
+        sockaddr_storage forwardAddress;
+        socklen_t forwardAddressLength;
+    };
+
+    bool makeUnixAddress(const std::string& path, sockaddr_un& address)
+    {
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            LOG(ERROR) << "Takeover socket path too long: " << path;
+            return false;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.data(), path.size());
+        return true;
+    }
+
+    void setTimeouts(int fd)
+    {
+        timeval timeout {.tv_sec = kTakeoverTimeoutSec, .tv_usec = 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+
+    bool sendState(int fd, const TakeoverState& state)
+    {
+        if (state.udpFds.empty() || state.udpFds.size() > kMaxTakeoverFds)
+        {
+            LOG(ERROR) << "Cannot hand over " << state.udpFds.size() << " sockets";
+            return false;
+        }
+        TakeoverHeader header {};
+        header.version   = kTakeoverVersion;
+        header.numFds    = state.udpFds.size();
+        header.processId = static_cast<uint8_t>(state.processId);
+        header.forwardAddressLength = state.forwardAddress.getAddress(&header.forwardAddress);
+
+        iovec iov {.iov_base = &header, .iov_len = sizeof(header)};
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * state.udpFds.size()));
+        msghdr msg {};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+        auto cmsg          = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level   = SOL_SOCKET;
+        cmsg->cmsg_type    = SCM_RIGHTS;
+        cmsg->cmsg_len     = CMSG_LEN(sizeof(int) * state.udpFds.size());
+        memcpy(CMSG_DATA(cmsg), state.udpFds.data(), sizeof(int) * state.udpFds.size());
+
+        if (sendmsg(fd, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(header)))
+        {
+            PLOG(ERROR) << "Failed to send takeover sockets";
+            return false;
+        }
+        return true;
+    }
+
+    folly::Optional<TakeoverState> receiveState(int fd)
+    {
+        TakeoverHeader header {};
+        iovec iov {.iov_base = &header, .iov_len = sizeof(header)};
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxTakeoverFds));
+        msghdr msg {};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.data();
+        msg.msg_controllen = control.size();
+        auto received      = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+        if (received != static_cast<ssize_t>(sizeof(header)))
+        {
+            PLOG(ERROR) << "Failed to receive takeover sockets";
+            return folly::none;
+        }
+
+        TakeoverState state;
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            {
+                continue;
+            }
+            auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            auto first = state.udpFds.size();
+            state.udpFds.resize(first + count);
+            memcpy(state.udpFds.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+        }
+        if (header.version != kTakeoverVersion || (msg.msg_flags & MSG_CTRUNC) ||
+            state.udpFds.size() != header.numFds)
+        {
+            LOG(ERROR) << "Malformed takeover message";
+            for (auto udpFd : state.udpFds)
+            {
+                close(udpFd);
+            }
+            return folly::none;
+        }
+        state.processId = static_cast<quic::ProcessId>(header.processId);
+        state.forwardAddress.setFromSockaddr(
+            reinterpret_cast<const sockaddr*>(&header.forwardAddress),
+            header.forwardAddressLength);
+        return state;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    folly::Optional<TakeoverClient> TakeoverClient::connect(const std::string& path)
+    {
+        sockaddr_un address;
+        if (!makeUnixAddress(path, address))
+        {
+            return folly::none;
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            PLOG(ERROR) << "Failed to create takeover socket";
+            return folly::none;
+        }
+        folly::File socket(fd, true);
+        if (::connect(socket.fd(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if (errno != ENOENT && errno != ECONNREFUSED)
+            {
+                PLOG(ERROR) << "Failed to connect to takeover socket " << path;
+            }
+            return folly::none;
+        }
+        setTimeouts(socket.fd());
+        auto state = receiveState(socket.fd());
+        if (!state)
+        {
+            return folly::none;
+        }
+        return TakeoverClient(std::move(socket), std::move(*state));
+    }
+
+    void TakeoverClient::complete()
+    {
+        const char ack = 1;
+        if (folly::writeNoInt(socket.fd(), &ack, sizeof(ack)) != sizeof(ack))
+        {
+            PLOG(ERROR) << "Failed to acknowledge takeover";
+        }
+        socket.close();
+    }
+
+    TakeoverListener::TakeoverListener(std::string listenPath,
+                                       std::function<TakeoverState()> provider,
+                                       std::function<void()> handedOver) :
+        path(std::move(listenPath)),
+        stateProvider(std::move(provider)),
+        onHandedOver(std::move(handedOver))
+    {
+        sockaddr_un address;
+        if (!makeUnixAddress(path, address))
+        {
+            return;
+        }
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            PLOG(ERROR) << "Failed to create takeover socket";
+            return;
+        }
+        socket = folly::File(fd, true);
+        // The predecessor is done with the path once it has handed over its sockets
+        unlink(path.c_str());
+        if (bind(socket.fd(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(socket.fd(), 1) != 0)
+        {
+            PLOG(ERROR) << "Failed to listen on takeover socket " << path;
+            socket.close();
+            return;
+        }
+        struct stat pathStat;
+        if (stat(path.c_str(), &pathStat) == 0)
+        {
+            socketInode = pathStat.st_ino;
+        }
+        thread = std::thread(&TakeoverListener::serve, this);
+    }
+
+    TakeoverListener::~TakeoverListener()
+    {
+        if (!thread.joinable())
+        {
+            return;
+        }
+        stopping = true;
+        // Wakes up the blocking accept()
+        shutdown(socket.fd(), SHUT_RDWR);
+        thread.join();
+        struct stat pathStat;
+        if (stat(path.c_str(), &pathStat) == 0 && pathStat.st_ino == socketInode)
+        {
+            unlink(path.c_str());
+        }
+    }
+
+    void TakeoverListener::serve()
+    {
+        while (!stopping)
+        {
+            int fd = accept4(socket.fd(), nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno != EINTR && !stopping)
+                {
+                    PLOG(ERROR) << "Takeover accept failed";
+                    return;
+                }
+                continue;
+            }
+            folly::File connection(fd, true);
+            if (handOver(connection.fd()))
+            {
+                onHandedOver();
+                return;
+            }
+        }
+    }
+
+    bool TakeoverListener::handOver(int connection)
+    {
+        setTimeouts(connection);
+        if (!sendState(connection, stateProvider()))
+        {
+            return false;
+        }
+        // The successor acks once its workers read from the sockets; until then both
+        // processes serve them
+        char ack = 0;
+        if (folly::readNoInt(connection, &ack, sizeof(ack)) != sizeof(ack) || ack != 1)
+        {
+            LOG(ERROR) << "Takeover was not acknowledged, keeping the sockets";
+            return false;
+        }
+        LOG(INFO) << "Sockets taken over by a new process";
+        return true;
+    }
+}  // namespace quic::samples
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <folly/File.h>
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+#include <quic/server/QuicServer.h>
+#include <sys/types.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace quic::samples
+{
+    // What a running server hands to the process that replaces it
+    struct TakeoverState
+    {
+        // Bound UDP sockets, one per worker
+        std::vector<int> udpFds;
+        quic::ProcessId processId = quic::ProcessId::ZERO;
+        // Where the old server receives packets of its connections while it drains
+        folly::SocketAddress forwardAddress;
+    };
+
+    /**
+     * New process side of a socket takeover.
+     *
+     * The exchange over the Unix socket is one message from the old server carrying
+     * its UDP sockets as SCM_RIGHTS, answered by a single byte once the new server
+     * reads from them.
+     */
+    class TakeoverClient
+    {
+    public:
+        // Receives the sockets of the server listening on path; none when there is none
+        static folly::Optional<TakeoverClient> connect(const std::string& path);
+
+        [[nodiscard]] const TakeoverState& getState() const
+        {
+            return state;
+        }
+
+        // Tells the old server to stop reading and start draining
+        void complete();
+
+    private:
+        TakeoverClient(folly::File socket, TakeoverState state) :
+            socket(std::move(socket)), state(std::move(state))
+        {
+        }
+
+        folly::File socket;
+        TakeoverState state;
+    };
+
+    /**
+     * Old process side of a socket takeover.
+     *
+     * Serves path on a background thread until one successor has acknowledged the
+     * sockets, then calls onHandedOver there. The path is unlinked on destruction
+     * unless the successor has already bound its own listener to it.
+     */
+    class TakeoverListener
+    {
+    public:
+        TakeoverListener(std::string path,
+                         std::function<TakeoverState()> stateProvider,
+                         std::function<void()> onHandedOver);
+
+        ~TakeoverListener();
+
+        TakeoverListener(const TakeoverListener&)            = delete;
+        TakeoverListener& operator=(const TakeoverListener&) = delete;
+
+    private:
+        void serve();
+
+        bool handOver(int connection);
+
+        std::string path;
+        std::function<TakeoverState()> stateProvider;
+        std::function<void()> onHandedOver;
+        folly::File socket;
+        ino_t socketInode = 0;
+        std::atomic<bool> stopping {false};
+        std::thread thread;
+    };
+}  // namespace quic::samples
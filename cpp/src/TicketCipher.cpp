@@ -0,0 +1,115 @@
+#include "TicketCipher.h"
+
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <glog/logging.h>
+
+namespace quic::samples
+{
+    void RotatingTicketCipher::setContext(std::shared_ptr<fizz::Factory> cipherFactory,
+                                          std::shared_ptr<fizz::server::CertManager> certs)
+    {
+        factory     = std::move(cipherFactory);
+        certManager = std::move(certs);
+    }
+
+    bool RotatingTicketCipher::setTicketSecrets(const std::vector<std::string>& secrets)
+    {
+        CHECK(factory) << "setContext() not called";
+        std::vector<folly::ByteRange> ranges;
+        for (const auto& secret : secrets)
+        {
+            ranges.emplace_back(folly::StringPiece(secret));
+        }
+        auto newCipher = std::make_shared<Cipher>(factory, certManager);
+        if (ranges.empty() || !newCipher->setTicketSecrets(ranges))
+        {
+            LOG(ERROR) << "Rejected " << secrets.size() << " ticket secrets";
+            return false;
+        }
+        *cipher.wlock() = std::move(newCipher);
+        return true;
+    }
+
+    std::shared_ptr<const RotatingTicketCipher::Cipher> RotatingTicketCipher::getCipher() const
+    {
+        return *cipher.rlock();
+    }
+
+    folly::SemiFuture<folly::Optional<std::pair<fizz::Buf, std::chrono::seconds>>>
+    RotatingTicketCipher::encrypt(fizz::server::ResumptionState resState) const
+    {
+        return getCipher()->encrypt(std::move(resState)).deferValue(
+            [](folly::Optional<std::pair<fizz::Buf, std::chrono::seconds>> ticket)
+            {
+                if (ticket)
+                {
+                    issued.fetch_add(1, std::memory_order_relaxed);
+                }
+                return ticket;
+            });
+    }
+
+    folly::SemiFuture<std::pair<fizz::PskType, folly::Optional<fizz::server::ResumptionState>>>
+    RotatingTicketCipher::decrypt(std::unique_ptr<folly::IOBuf> encryptedTicket) const
+    {
+        return getCipher()->decrypt(std::move(encryptedTicket)).deferValue(
+            [](std::pair<fizz::PskType, folly::Optional<fizz::server::ResumptionState>> result)
+            {
+                if (result.first == fizz::PskType::Resumption)
+                {
+                    resumed.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    rejected.fetch_add(1, std::memory_order_relaxed);
+                }
+                return result;
+            });
+    }
+
+    TicketCipherStats RotatingTicketCipher::getStats()
+    {
+        return {
+            .issued   = issued.load(std::memory_order_relaxed),
+            .resumed  = resumed.load(std::memory_order_relaxed),
+            .rejected = rejected.load(std::memory_order_relaxed),
+        };
+    }
+
+    bool readTicketSecrets(const std::string& path, std::vector<std::string>& secrets)
+    {
+        std::string contents;
+        if (!folly::readFile(path.c_str(), contents))
+        {
+            PLOG(ERROR) << "Failed to read ticket key file " << path;
+            return false;
+        }
+        std::vector<folly::StringPiece> lines;
+        folly::split('\n', contents, lines);
+        std::vector<std::string> parsed;
+        for (auto line : lines)
+        {
+            line = folly::trimWhitespace(line);
+            if (line.empty() || line.startsWith('#'))
+            {
+                continue;
+            }
+            std::string secret;
+            if (!folly::unhexlify(line, secret) || secret.size() < 32)
+            {
+                LOG(ERROR) << "Invalid ticket secret in " << path
+                           << ", expected at least 32 hex encoded bytes per line";
+                return false;
+            }
+            parsed.push_back(std::move(secret));
+        }
+        if (parsed.empty())
+        {
+            LOG(ERROR) << "No ticket secrets in " << path;
+            return false;
+        }
+        secrets = std::move(parsed);
+        return true;
+    }
+}  // namespace quic::samples
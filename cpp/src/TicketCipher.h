@@ -0,0 +1,70 @@
+#pragma once
+
+#include <fizz/server/AeadTicketCipher.h>
+#include <fizz/server/CertManager.h>
+#include <fizz/server/TicketCodec.h>
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace quic::samples
+{
+    struct TicketCipherStats
+    {
+        uint64_t issued   = 0;
+        uint64_t resumed  = 0;
+        uint64_t rejected = 0;
+    };
+
+    /**
+     * Session ticket cipher whose secrets can be replaced while workers use it.
+     *
+     * setTicketSecrets() builds a fresh AEAD cipher and swaps it in, so handshakes in
+     * flight keep the cipher they started with. Issued tickets and the outcome of
+     * every presented ticket are counted process-wide.
+     */
+    class RotatingTicketCipher : public fizz::server::TicketCipher
+    {
+    public:
+        // Must be called once, before the first setTicketSecrets()
+        void setContext(std::shared_ptr<fizz::Factory> factory,
+                        std::shared_ptr<fizz::server::CertManager> certManager);
+
+        // The first secret encrypts new tickets, every secret decrypts. Returns false
+        // and keeps the current secrets if they are rejected
+        bool setTicketSecrets(const std::vector<std::string>& secrets);
+
+        folly::SemiFuture<folly::Optional<std::pair<fizz::Buf, std::chrono::seconds>>> encrypt(
+            fizz::server::ResumptionState resState) const override;
+
+        folly::SemiFuture<std::pair<fizz::PskType, folly::Optional<fizz::server::ResumptionState>>>
+        decrypt(std::unique_ptr<folly::IOBuf> encryptedTicket) const override;
+
+        static TicketCipherStats getStats();
+
+    private:
+        using Cipher = fizz::server::Aead128GCMTicketCipher<
+            fizz::server::TicketCodec<fizz::server::CertificateStorage::X509>>;
+
+        std::shared_ptr<const Cipher> getCipher() const;
+
+        std::shared_ptr<fizz::Factory> factory;
+        std::shared_ptr<fizz::server::CertManager> certManager;
+        folly::Synchronized<std::shared_ptr<const Cipher>> cipher;
+
+        static inline std::atomic<uint64_t> issued {0};
+        static inline std::atomic<uint64_t> resumed {0};
+        static inline std::atomic<uint64_t> rejected {0};
+    };
+
+    /**
+     * Reads ticket secrets from a key file shared by all server processes.
+     *
+     * One hex encoded secret of at least 32 bytes per line, newest first; empty lines
+     * and lines starting with '#' are skipped. Rotating means prepending a new secret
+     * and dropping the oldest one once its tickets have expired.
+     */
+    bool readTicketSecrets(const std::string& path, std::vector<std::string>& secrets);
+}  // namespace quic::samples
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <folly/tracing/StaticTracepoint.h>
+
+/**
+ * Static (USDT) tracepoints of the sample server and client.
+ *
+ * Every probe is registered under the "webtransport_sample" provider and costs a
+ * single nop while nobody is attached, so they stay compiled in. List them with
+ *
+ *   bpftrace -l 'usdt:./main:webtransport_sample:*'
+ *
+ * Probes and their arguments:
+ *   request_dispatch   route id, path length
+ *   handler_attach     handler, HTTP stream id
+ *   handler_detach     handler
+ *   stream_open        WebTransport stream id, 1 if bidirectional
+ *   stream_close       WebTransport stream id, 1 on error/reset
+ *   datagram_send      length
+ *   datagram_recv      length
+ *   baton_parse        WebTransport stream id, baton
+ *   transport_ready    1 if the ALPN has a dedicated handler
+ */
+#define SAMPLE_TRACE(name, ...) FOLLY_SDT(webtransport_sample, name, __VA_ARGS__)
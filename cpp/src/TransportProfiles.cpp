@@ -0,0 +1,292 @@
+#include "TransportProfiles.h"
+
+#include <folly/FileUtil.h>
+#include <folly/json.h>
+#include <glog/logging.h>
+#include <quic/QuicException.h>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+namespace
+{
+    using quic::samples::TransportProfile;
+
+    // Largest value a QUIC variable-length integer can carry
+    constexpr uint64_t kMaxVarInt = (uint64_t(1) << 62) - 1;
+
+    struct Field
+    {
+        const char* key;
+        folly::Optional<uint64_t> TransportProfile::*member;
+        uint64_t max;
+    };
+
+    const Field kFields[] = {
+        {"idle_timeout_ms", &TransportProfile::idleTimeoutMs, std::numeric_limits<uint32_t>::max()},
+        {"conn_flow_control", &TransportProfile::connFlowControl, kMaxVarInt},
+        {"stream_flow_control", &TransportProfile::streamFlowControl, kMaxVarInt},
+        {"max_streams_bidi", &TransportProfile::maxStreamsBidi, kMaxVarInt},
+        {"max_streams_uni", &TransportProfile::maxStreamsUni, kMaxVarInt},
+        {"max_recv_batch_size",
+         &TransportProfile::maxRecvBatchSize,
+         std::numeric_limits<uint32_t>::max()},
+        {"max_cwnd_mss", &TransportProfile::maxCwndMss, kMaxVarInt},
+    };
+
+    bool parseProfile(const folly::dynamic& fields, TransportProfile& profile)
+    {
+        if (!fields.isObject())
+        {
+            LOG(ERROR) << "Transport profile " << profile.name << " is not an object";
+            return false;
+        }
+        for (const auto& [key, value] : fields.items())
+        {
+            auto field = std::find_if(std::begin(kFields),
+                                      std::end(kFields),
+                                      [&key = key](const Field& candidate)
+                                      {
+                                          return key.asString() == candidate.key;
+                                      });
+            if (field == std::end(kFields))
+            {
+                LOG(ERROR) << "Unknown field " << key.asString() << " in transport profile "
+                           << profile.name;
+                return false;
+            }
+            if (!value.isInt() || value.asInt() <= 0 ||
+                static_cast<uint64_t>(value.asInt()) > field->max)
+            {
+                LOG(ERROR) << "Transport profile " << profile.name << ": " << field->key
+                           << " must be an integer in [1, " << field->max << "]";
+                return false;
+            }
+            profile.*(field->member) = static_cast<uint64_t>(value.asInt());
+        }
+        return true;
+    }
+
+    // Whether the profile sets fields that only take effect in the handshake
+    bool setsHandshakeFields(const TransportProfile& profile)
+    {
+        return std::any_of(std::begin(kFields),
+                           std::end(kFields),
+                           [&profile](const Field& field)
+                           {
+                               return field.member != &TransportProfile::connFlowControl &&
+                                      (profile.*(field.member)).has_value();
+                           });
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    void TransportProfile::apply(quic::TransportSettings& settings) const
+    {
+        if (idleTimeoutMs)
+        {
+            settings.idleTimeout = std::chrono::milliseconds(*idleTimeoutMs);
+        }
+        if (connFlowControl)
+        {
+            settings.advertisedInitialConnectionFlowControlWindow = *connFlowControl;
+        }
+        if (streamFlowControl)
+        {
+            settings.advertisedInitialBidiLocalStreamFlowControlWindow  = *streamFlowControl;
+            settings.advertisedInitialBidiRemoteStreamFlowControlWindow = *streamFlowControl;
+            settings.advertisedInitialUniStreamFlowControlWindow        = *streamFlowControl;
+        }
+        if (maxStreamsBidi)
+        {
+            settings.advertisedInitialMaxStreamsBidi = *maxStreamsBidi;
+        }
+        if (maxStreamsUni)
+        {
+            settings.advertisedInitialMaxStreamsUni = *maxStreamsUni;
+        }
+        if (maxRecvBatchSize)
+        {
+            settings.maxRecvBatchSize = static_cast<uint32_t>(*maxRecvBatchSize);
+        }
+        if (maxCwndMss)
+        {
+            settings.maxCwndInMss = *maxCwndMss;
+        }
+    }
+
+    bool TransportProfiles::load(const std::string& path, const quic::TransportSettings& base)
+    {
+        TransportProfileSet profiles;
+        if (!readTransportProfiles(path, profiles))
+        {
+            reloadFailures.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        auto window = base.advertisedInitialConnectionFlowControlWindow;
+        if (profiles.defaultProfile && profiles.defaultProfile->connFlowControl)
+        {
+            window = *profiles.defaultProfile->connFlowControl;
+        }
+        for (const auto& [alpn, profile] : profiles.alpnProfiles)
+        {
+            // The handshake already advertised the default window, MAX_DATA cannot
+            // take it back
+            if (profile.connFlowControl && *profile.connFlowControl < window)
+            {
+                LOG(WARNING) << "conn_flow_control " << *profile.connFlowControl
+                             << " of profile " << profile.name << " for ALPN " << alpn
+                             << " is below the default window " << window
+                             << " and cannot shrink it";
+            }
+        }
+        LOG(INFO) << "Loaded transport profiles from " << path << ": default="
+                  << (profiles.defaultProfile ? profiles.defaultProfile->name : "none")
+                  << " alpns=" << profiles.alpnProfiles.size();
+        *current.wlock() = std::make_shared<const TransportProfileSet>(std::move(profiles));
+        reloads.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void TransportProfiles::applyDefault(quic::TransportSettings& settings) const
+    {
+        auto profiles = current.copy();
+        if (profiles && profiles->defaultProfile)
+        {
+            profiles->defaultProfile->apply(settings);
+        }
+    }
+
+    folly::Optional<std::chrono::milliseconds> TransportProfiles::getDefaultIdleTimeout() const
+    {
+        auto profiles = current.copy();
+        if (!profiles || !profiles->defaultProfile || !profiles->defaultProfile->idleTimeoutMs)
+        {
+            return folly::none;
+        }
+        return std::chrono::milliseconds(*profiles->defaultProfile->idleTimeoutMs);
+    }
+
+    void TransportProfiles::applyAlpn(const std::string& alpn, quic::QuicSocket& socket) const
+    {
+        auto profiles = current.copy();
+        if (!profiles)
+        {
+            return;
+        }
+        auto iter = profiles->alpnProfiles.find(alpn);
+        if (iter == profiles->alpnProfiles.end() || !iter->second.connFlowControl)
+        {
+            return;
+        }
+        auto result = socket.setConnectionFlowControlWindow(*iter->second.connFlowControl);
+        if (result.hasError())
+        {
+            LOG(ERROR) << "Failed to apply transport profile " << iter->second.name
+                       << " to ALPN " << alpn << ": " << quic::toString(result.error());
+            return;
+        }
+        alpnOverrides.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    TransportProfileStats TransportProfiles::getStats()
+    {
+        return {
+            .reloads        = reloads.load(std::memory_order_relaxed),
+            .reloadFailures = reloadFailures.load(std::memory_order_relaxed),
+            .alpnOverrides  = alpnOverrides.load(std::memory_order_relaxed),
+        };
+    }
+
+    bool readTransportProfiles(const std::string& path, TransportProfileSet& profiles)
+    {
+        std::string contents;
+        if (!folly::readFile(path.c_str(), contents))
+        {
+            PLOG(ERROR) << "Failed to read transport profiles " << path;
+            return false;
+        }
+        folly::dynamic json;
+        try
+        {
+            json = folly::parseJson(contents);
+        }
+        catch (const std::exception& ex)
+        {
+            LOG(ERROR) << "Invalid JSON in " << path << ": " << ex.what();
+            return false;
+        }
+        auto named = json.isObject() ? json.get_ptr("profiles") : nullptr;
+        if (!named || !named->isObject())
+        {
+            LOG(ERROR) << "Expected a \"profiles\" object in " << path;
+            return false;
+        }
+        for (const auto& key : json.keys())
+        {
+            auto name = key.asString();
+            if (name != "profiles" && name != "default" && name != "alpns")
+            {
+                LOG(ERROR) << "Unknown key " << name << " in " << path;
+                return false;
+            }
+        }
+
+        std::map<std::string, TransportProfile> byName;
+        for (const auto& [name, fields] : named->items())
+        {
+            TransportProfile profile;
+            profile.name = name.asString();
+            if (!parseProfile(fields, profile))
+            {
+                return false;
+            }
+            byName.emplace(profile.name, std::move(profile));
+        }
+        auto find = [&byName](const folly::dynamic& name) -> const TransportProfile*
+        {
+            auto iter = name.isString() ? byName.find(name.asString()) : byName.end();
+            return iter == byName.end() ? nullptr : &iter->second;
+        };
+
+        TransportProfileSet parsed;
+        if (auto defaultName = json.get_ptr("default"))
+        {
+            auto profile = find(*defaultName);
+            if (!profile)
+            {
+                LOG(ERROR) << "Unknown default profile " << folly::toJson(*defaultName) << " in "
+                           << path;
+                return false;
+            }
+            parsed.defaultProfile = *profile;
+        }
+        if (auto alpns = json.get_ptr("alpns"))
+        {
+            if (!alpns->isObject())
+            {
+                LOG(ERROR) << "Expected \"alpns\" to map ALPNs to profiles in " << path;
+                return false;
+            }
+            for (const auto& [alpn, name] : alpns->items())
+            {
+                auto profile = find(name);
+                if (!profile)
+                {
+                    LOG(ERROR) << "Unknown profile " << folly::toJson(name) << " for ALPN "
+                               << alpn.asString() << " in " << path;
+                    return false;
+                }
+                if (setsHandshakeFields(*profile))
+                {
+                    LOG(WARNING) << "Only conn_flow_control of profile " << profile->name
+                                 << " applies to ALPN " << alpn.asString();
+                }
+                parsed.alpnProfiles.emplace(alpn.asString(), *profile);
+            }
+        }
+        profiles = std::move(parsed);
+        return true;
+    }
+}  // namespace quic::samples
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Synchronized.h>
+#include <quic/api/QuicSocket.h>
+#include <quic/state/TransportSettings.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace quic::samples
+{
+    /**
+     * Named set of transport setting overrides, unset fields keep the command line value.
+     */
+    struct TransportProfile
+    {
+        std::string name;
+        folly::Optional<uint64_t> idleTimeoutMs;
+        folly::Optional<uint64_t> connFlowControl;
+        folly::Optional<uint64_t> streamFlowControl;
+        folly::Optional<uint64_t> maxStreamsBidi;
+        folly::Optional<uint64_t> maxStreamsUni;
+        folly::Optional<uint64_t> maxRecvBatchSize;
+        folly::Optional<uint64_t> maxCwndMss;
+
+        void apply(quic::TransportSettings& settings) const;
+    };
+
+    struct TransportProfileSet
+    {
+        // Applied to every new connection
+        folly::Optional<TransportProfile> defaultProfile;
+        // Applied once the ALPN is negotiated, see TransportProfiles::applyAlpn()
+        std::map<std::string, TransportProfile> alpnProfiles;
+    };
+
+    struct TransportProfileStats
+    {
+        uint64_t reloads        = 0;
+        uint64_t reloadFailures = 0;
+        uint64_t alpnOverrides  = 0;
+    };
+
+    /**
+     * Transport profiles that can be replaced while the server runs.
+     *
+     * load() swaps in a new TransportProfileSet; connections accepted afterwards use
+     * it, established ones keep what they negotiated.
+     */
+    class TransportProfiles
+    {
+    public:
+        // Returns false and keeps the current profiles if path is invalid. base is the
+        // command line settings, used to check the ALPN profiles against
+        bool load(const std::string& path, const quic::TransportSettings& base);
+
+        // Applies the default profile to the settings of a connection being accepted, or
+        // of the workers. max_recv_batch_size only takes effect in the latter.
+        void applyDefault(quic::TransportSettings& settings) const;
+
+        // idle_timeout_ms of the default profile, if any
+        [[nodiscard]] folly::Optional<std::chrono::milliseconds> getDefaultIdleTimeout() const;
+
+        // Transport parameters are sent before the ALPN is known, so a profile bound
+        // to an ALPN only raises the connection receive window, through MAX_DATA
+        void applyAlpn(const std::string& alpn, quic::QuicSocket& socket) const;
+
+        static TransportProfileStats getStats();
+
+    private:
+        folly::Synchronized<std::shared_ptr<const TransportProfileSet>> current;
+
+        static inline std::atomic<uint64_t> reloads {0};
+        static inline std::atomic<uint64_t> reloadFailures {0};
+        static inline std::atomic<uint64_t> alpnOverrides {0};
+    };
+
+    /**
+     * Reads transport profiles from a JSON file.
+     *
+     *   {
+     *     "profiles": {"web": {"max_streams_bidi": 200}, "bulk": {"conn_flow_control": 67108864}},
+     *     "default": "web",
+     *     "alpns": {"hq-interop": "bulk"}
+     *   }
+     *
+     * Profile fields are idle_timeout_ms, conn_flow_control, stream_flow_control,
+     * max_streams_bidi, max_streams_uni, max_recv_batch_size and max_cwnd_mss, all
+     * positive integers. "default" and "alpns" are optional.
+     */
+    bool readTransportProfiles(const std::string& path, TransportProfileSet& profiles);
+}  // namespace quic::samples
@@ -0,0 +1,284 @@
+#include "UdpBatchingCalibration.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+#include <quic/QuicConstants.h>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t kPacketSize     = quic::kDefaultUDPSendPacketLen;
+    constexpr auto kMeasureDuration  = std::chrono::milliseconds(50);
+    constexpr std::array kBatchSizes = {8u, 16u, 32u};
+    // Receive buffers per GRO read when the kernel coalesces
+    constexpr uint32_t kGroBuffers = 16;
+
+    struct Candidate
+    {
+        quic::QuicBatchingMode mode = quic::QuicBatchingMode::BATCHING_MODE_NONE;
+        uint32_t batchSize          = 1;
+        double bytesPerSecond       = 0;
+    };
+
+    const char* getName(quic::QuicBatchingMode mode)
+    {
+        switch (mode)
+        {
+            case quic::QuicBatchingMode::BATCHING_MODE_NONE:
+                return "none";
+            case quic::QuicBatchingMode::BATCHING_MODE_GSO:
+                return "gso";
+            case quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG:
+                return "sendmmsg";
+            case quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO:
+                return "sendmmsg_gso";
+        }
+        return "unknown";
+    }
+
+    // A sender connected to a receiver on loopback; nothing reads, the kernel drops
+    // what overflows the receive buffer after doing the send side work
+    class LoopbackPair
+    {
+    public:
+        LoopbackPair()
+        {
+            receiver = ::socket(AF_INET, SOCK_DGRAM, 0);
+            sender   = ::socket(AF_INET, SOCK_DGRAM, 0);
+            if (receiver < 0 || sender < 0)
+            {
+                return;
+            }
+            sockaddr_in addr {};
+            addr.sin_family      = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t addrLen    = sizeof(addr);
+            if (::bind(receiver, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0 ||
+                ::getsockname(receiver, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0 ||
+                ::connect(sender, reinterpret_cast<sockaddr*>(&addr), addrLen) != 0)
+            {
+                return;
+            }
+            connected = true;
+        }
+
+        ~LoopbackPair()
+        {
+            for (auto fd : {sender, receiver})
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+        }
+
+        LoopbackPair(const LoopbackPair&)            = delete;
+        LoopbackPair& operator=(const LoopbackPair&) = delete;
+
+        int sender     = -1;
+        int receiver   = -1;
+        bool connected = false;
+    };
+
+    bool probeGso(int fd)
+    {
+        int segment = kPacketSize;
+        return ::setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, sizeof(segment)) == 0;
+    }
+
+    bool probeGro(int fd)
+    {
+        int enable = 1;
+        return ::setsockopt(fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0;
+    }
+
+    bool probeSendmmsg(int fd)
+    {
+        char byte = 0;
+        iovec iov {.iov_base = &byte, .iov_len = sizeof(byte)};
+        mmsghdr message {};
+        message.msg_hdr.msg_iov    = &iov;
+        message.msg_hdr.msg_iovlen = 1;
+        return ::sendmmsg(fd, &message, 1, 0) == 1;
+    }
+
+    bool probeRecvmmsg(int fd)
+    {
+        std::array<char, kPacketSize> buffer;
+        iovec iov {.iov_base = buffer.data(), .iov_len = buffer.size()};
+        mmsghdr message {};
+        message.msg_hdr.msg_iov    = &iov;
+        message.msg_hdr.msg_iovlen = 1;
+        // Either reads the sendmmsg probe or finds nothing, only ENOSYS means missing
+        return ::recvmmsg(fd, &message, 1, MSG_DONTWAIT, nullptr) >= 0 || errno != ENOSYS;
+    }
+
+    // Bytes written by one batch, -1 on error
+    ssize_t sendBatch(int fd, quic::QuicBatchingMode mode, uint32_t batchSize, char* payload)
+    {
+        switch (mode)
+        {
+            case quic::QuicBatchingMode::BATCHING_MODE_GSO:
+            {
+                iovec iov {.iov_base = payload, .iov_len = kPacketSize * batchSize};
+                alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+                msghdr message {};
+                message.msg_iov        = &iov;
+                message.msg_iovlen     = 1;
+                message.msg_control    = control;
+                message.msg_controllen = sizeof(control);
+                auto cmsg              = CMSG_FIRSTHDR(&message);
+                cmsg->cmsg_level       = SOL_UDP;
+                cmsg->cmsg_type        = UDP_SEGMENT;
+                cmsg->cmsg_len         = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segment       = kPacketSize;
+                std::memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+                return ::sendmsg(fd, &message, 0);
+            }
+            case quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG:
+            {
+                std::array<iovec, kBatchSizes.back()> iovs;
+                std::array<mmsghdr, kBatchSizes.back()> messages {};
+                for (uint32_t i = 0; i < batchSize; ++i)
+                {
+                    iovs[i] = {.iov_base = payload + i * kPacketSize, .iov_len = kPacketSize};
+                    messages[i].msg_hdr.msg_iov    = &iovs[i];
+                    messages[i].msg_hdr.msg_iovlen = 1;
+                }
+                auto sent = ::sendmmsg(fd, messages.data(), batchSize, 0);
+                return sent < 0 ? -1 : sent * static_cast<ssize_t>(kPacketSize);
+            }
+            default:
+            {
+                ssize_t total = 0;
+                for (uint32_t i = 0; i < batchSize; ++i)
+                {
+                    if (::send(fd, payload + i * kPacketSize, kPacketSize, 0) < 0)
+                    {
+                        return -1;
+                    }
+                    total += kPacketSize;
+                }
+                return total;
+            }
+        }
+    }
+
+    // Send throughput of one candidate, 0 when the mode fails at runtime
+    double measure(int fd, quic::QuicBatchingMode mode, uint32_t batchSize)
+    {
+        std::vector<char> payload(kPacketSize * kBatchSizes.back());
+        uint64_t bytes = 0;
+        auto start     = Clock::now();
+        auto deadline  = start + kMeasureDuration;
+        while (Clock::now() < deadline)
+        {
+            auto sent = sendBatch(fd, mode, batchSize, payload.data());
+            if (sent < 0)
+            {
+                PLOG(WARNING) << "UDP batching mode " << getName(mode)
+                              << " failed during calibration";
+                return 0;
+            }
+            bytes += sent;
+        }
+        auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        return bytes / elapsed;
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    void calibrateUdpBatching(quic::TransportSettings& settings)
+    {
+        LoopbackPair pair;
+        if (!pair.connected)
+        {
+            PLOG(ERROR) << "UDP batching calibration skipped, no loopback socket pair";
+            return;
+        }
+        bool gso      = probeGso(pair.sender);
+        bool gro      = probeGro(pair.receiver);
+        bool sendmmsg = probeSendmmsg(pair.sender);
+        bool recvmmsg = probeRecvmmsg(pair.receiver);
+        LOG(INFO) << "UDP offloads: gso=" << gso << " gro=" << gro << " sendmmsg=" << sendmmsg
+                  << " recvmmsg=" << recvmmsg;
+        // Undo the probes: the GSO candidate sets the segment size per call, and GRO
+        // would hand the receiver whole GSO buffers
+        int disable = 0;
+        ::setsockopt(pair.sender, SOL_UDP, UDP_SEGMENT, &disable, sizeof(disable));
+        ::setsockopt(pair.receiver, SOL_UDP, UDP_GRO, &disable, sizeof(disable));
+
+        std::vector<Candidate> candidates;
+        candidates.push_back({.mode = quic::QuicBatchingMode::BATCHING_MODE_NONE});
+        for (auto batchSize : kBatchSizes)
+        {
+            if (gso)
+            {
+                candidates.push_back(
+                    {.mode = quic::QuicBatchingMode::BATCHING_MODE_GSO, .batchSize = batchSize});
+            }
+            if (sendmmsg)
+            {
+                candidates.push_back({.mode      = quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG,
+                                      .batchSize = batchSize});
+            }
+        }
+
+        const Candidate* best = nullptr;
+        for (auto& candidate : candidates)
+        {
+            candidate.bytesPerSecond = measure(pair.sender, candidate.mode, candidate.batchSize);
+            LOG(INFO) << "UDP batching mode " << getName(candidate.mode) << " batch "
+                      << candidate.batchSize << ": "
+                      << static_cast<uint64_t>(candidate.bytesPerSecond / 1000000) << " MB/s";
+            if (!best || candidate.bytesPerSecond > best->bytesPerSecond)
+            {
+                best = &candidate;
+            }
+        }
+        if (best->bytesPerSecond == 0)
+        {
+            LOG(ERROR) << "UDP batching calibration failed, keeping the configured mode";
+            return;
+        }
+
+        settings.batchingMode = best->mode;
+        settings.maxBatchSize = best->batchSize;
+        if (!recvmmsg)
+        {
+            settings.shouldUseRecvmmsgForBatchRecv = false;
+        }
+        if (gro && settings.numGROBuffers_ <= 1)
+        {
+            settings.numGROBuffers_ = kGroBuffers;
+        }
+        else if (!gro)
+        {
+            settings.numGROBuffers_ = 1;
+        }
+        LOG(INFO) << "UDP batching calibrated: mode=" << getName(settings.batchingMode)
+                  << " maxBatchSize=" << settings.maxBatchSize
+                  << " recvmmsg=" << settings.shouldUseRecvmmsgForBatchRecv
+                  << " groBuffers=" << settings.numGROBuffers_;
+    }
+}  // namespace quic::samples
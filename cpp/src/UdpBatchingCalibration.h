@@ -0,0 +1,17 @@
+#pragma once
+
+#include <quic/state/TransportSettings.h>
+
+namespace quic::samples
+{
+    /**
+     * Picks the UDP write batching mode and batch size for this kernel.
+     *
+     * Probes UDP_SEGMENT (GSO), UDP_GRO, sendmmsg and recvmmsg support on a loopback
+     * socket pair, then measures send throughput of every supported batching mode at
+     * a few batch sizes for a short while each. The fastest combination is written to
+     * batchingMode and maxBatchSize; GRO and recvmmsg support adjust the receive path.
+     * Takes well under a second; leaves settings untouched where probing fails.
+     */
+    void calibrateUdpBatching(quic::TransportSettings& settings);
+}  // namespace quic::samples
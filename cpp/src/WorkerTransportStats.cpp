@@ -0,0 +1,78 @@
+#include "WorkerTransportStats.h"
+
+#include <folly/io/async/EventBaseManager.h>
+#include <algorithm>
+
+namespace
+{
+    uint64_t load(const std::atomic<uint64_t>& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+}  // namespace
+
+namespace quic::samples
+{
+    WorkerTransportStats::WorkerTransportStats(folly::EventBase* evb) : eventBase(evb)
+    {
+        allStats.wlock()->push_back(this);
+    }
+
+    WorkerTransportStats::~WorkerTransportStats()
+    {
+        auto lockedStats = allStats.wlock();
+        lockedStats->erase(std::remove(lockedStats->begin(), lockedStats->end(), this),
+                           lockedStats->end());
+    }
+
+    std::vector<WorkerStatsSnapshot> WorkerTransportStats::getSnapshots()
+    {
+        std::vector<WorkerStatsSnapshot> result;
+        auto lockedStats = allStats.rlock();
+        result.reserve(lockedStats->size());
+        for (auto stats : *lockedStats)
+        {
+            const auto& counters = stats->counters;
+            WorkerStatsSnapshot snapshot {
+                .eventBase         = stats->eventBase,
+                .packetsReceived   = load(counters.packetsReceived),
+                .packetsSent       = load(counters.packetsSent),
+                .packetsDropped    = load(counters.packetsDropped),
+                .packetsLost       = load(counters.packetsLost),
+                .retransmissions   = load(counters.retransmissions),
+                .ptos              = load(counters.ptos),
+                .bytesRead         = load(counters.bytesRead),
+                .bytesWritten      = load(counters.bytesWritten),
+                .newConnections    = load(counters.newConnections),
+                .closedConnections = load(counters.closedConnections),
+                .streamsOpened     = load(counters.streamsOpened),
+                .streamsClosed     = load(counters.streamsClosed),
+                .streamsReset      = load(counters.streamsReset),
+                .zeroRttAccepted   = load(counters.zeroRttAccepted),
+                .zeroRttRejected   = load(counters.zeroRttRejected),
+            };
+            const auto& histogram = stats->rttHistogram;
+            for (size_t i = 0; i < histogram.counts.size(); ++i)
+            {
+                snapshot.rtt.counts[i] = load(histogram.counts[i]);
+            }
+            snapshot.rtt.sumUs = load(histogram.sumUs);
+            result.push_back(snapshot);
+        }
+        return result;
+    }
+
+    void WorkerTransportStats::onRttSample(uint64_t rtt)
+    {
+        auto bucket = std::lower_bound(kRttBucketBoundsUs.begin(), kRttBucketBoundsUs.end(), rtt) -
+                      kRttBucketBoundsUs.begin();
+        bump(rttHistogram.counts[bucket]);
+        bump(rttHistogram.sumUs, rtt);
+    }
+
+    std::unique_ptr<quic::QuicTransportStatsCallback> WorkerTransportStatsFactory::make()
+    {
+        return std::make_unique<WorkerTransportStats>(
+            folly::EventBaseManager::get()->getExistingEventBase());
+    }
+}  // namespace quic::samples
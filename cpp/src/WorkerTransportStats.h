@@ -0,0 +1,276 @@
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/lang/Align.h>
+#include <quic/state/QuicTransportStatsCallback.h>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace quic::samples
+{
+    // Upper bounds of the RTT histogram buckets in microseconds; one more bucket
+    // catches everything above the last bound
+    inline constexpr std::array<uint64_t, 12> kRttBucketBoundsUs = {
+        250, 500, 1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+
+    struct RttHistogramSnapshot
+    {
+        // Per bucket, not cumulative
+        std::array<uint64_t, kRttBucketBoundsUs.size() + 1> counts {};
+        uint64_t sumUs = 0;
+    };
+
+    struct WorkerStatsSnapshot
+    {
+        folly::EventBase* eventBase = nullptr;
+        uint64_t packetsReceived    = 0;
+        uint64_t packetsSent        = 0;
+        uint64_t packetsDropped     = 0;
+        uint64_t packetsLost        = 0;
+        uint64_t retransmissions    = 0;
+        uint64_t ptos               = 0;
+        uint64_t bytesRead          = 0;
+        uint64_t bytesWritten       = 0;
+        uint64_t newConnections     = 0;
+        uint64_t closedConnections  = 0;
+        uint64_t streamsOpened      = 0;
+        uint64_t streamsClosed      = 0;
+        uint64_t streamsReset       = 0;
+        uint64_t zeroRttAccepted    = 0;
+        uint64_t zeroRttRejected    = 0;
+        RttHistogramSnapshot rtt;
+    };
+
+    /**
+     * Transport counters of one QUIC server worker.
+     *
+     * mvfst hands every worker its own callback and only calls it from that
+     * worker's thread, so counters are bumped with a relaxed load/store pair
+     * instead of a locked read-modify-write. Readers on other threads see
+     * monotonic, possibly slightly stale values.
+     */
+    class WorkerTransportStats : public quic::QuicTransportStatsCallback
+    {
+    public:
+        explicit WorkerTransportStats(folly::EventBase* evb);
+
+        ~WorkerTransportStats() override;
+
+        WorkerTransportStats(const WorkerTransportStats&)            = delete;
+        WorkerTransportStats& operator=(const WorkerTransportStats&) = delete;
+
+        // One entry per live worker, in creation order
+        static std::vector<WorkerStatsSnapshot> getSnapshots();
+
+        void onPacketReceived() override
+        {
+            bump(counters.packetsReceived);
+        }
+
+        void onDuplicatedPacketReceived() override {}
+
+        void onOutOfOrderPacketReceived() override {}
+
+        void onPacketProcessed() override {}
+
+        void onPacketSent() override
+        {
+            bump(counters.packetsSent);
+        }
+
+        void onDSRPacketSent(size_t /*pktSize*/) override {}
+
+        void onPacketRetransmission() override
+        {
+            bump(counters.retransmissions);
+        }
+
+        void onPacketLoss() override
+        {
+            bump(counters.packetsLost);
+        }
+
+        void onPacketSpuriousLoss() override {}
+
+        void onPersistentCongestion() override {}
+
+        void onPacketDropped(PacketDropReason /*reason*/) override
+        {
+            bump(counters.packetsDropped);
+        }
+
+        void onPacketForwarded() override {}
+
+        void onForwardedPacketReceived() override {}
+
+        void onForwardedPacketProcessed() override {}
+
+        void onClientInitialReceived(QuicVersion /*version*/) override {}
+
+        void onConnectionRateLimited() override {}
+
+        void onConnectionWritableBytesLimited() override {}
+
+        void onNewTokenReceived() override {}
+
+        void onNewTokenIssued() override {}
+
+        void onTokenDecryptFailure() override {}
+
+        void onNewConnection() override
+        {
+            bump(counters.newConnections);
+        }
+
+        void onConnectionClose(folly::Optional<QuicErrorCode> /*code*/) override
+        {
+            bump(counters.closedConnections);
+        }
+
+        void onConnectionCloseZeroBytesWritten() override {}
+
+        void onPeerMaxUniStreamsLimitSaturated() override {}
+
+        void onPeerMaxBidiStreamsLimitSaturated() override {}
+
+        void onNewQuicStream() override
+        {
+            bump(counters.streamsOpened);
+        }
+
+        void onQuicStreamClosed() override
+        {
+            bump(counters.streamsClosed);
+        }
+
+        void onQuicStreamReset(QuicErrorCode /*code*/) override
+        {
+            bump(counters.streamsReset);
+        }
+
+        void onConnFlowControlUpdate() override {}
+
+        void onConnFlowControlBlocked() override {}
+
+        void onStatelessReset() override {}
+
+        void onStreamFlowControlUpdate() override {}
+
+        void onStreamFlowControlBlocked() override {}
+
+        void onCwndBlocked() override {}
+
+        void onInflightBytesSample(uint64_t /*inflightBytes*/) override {}
+
+        void onRttSample(uint64_t rtt) override;
+
+        void onBandwidthSample(uint64_t /*bandwidth*/) override {}
+
+        void onNewCongestionController(CongestionControlType /*type*/) override {}
+
+        void onPTO() override
+        {
+            bump(counters.ptos);
+        }
+
+        void onRead(size_t bufSize) override
+        {
+            bump(counters.bytesRead, bufSize);
+        }
+
+        void onWrite(size_t bufSize) override
+        {
+            bump(counters.bytesWritten, bufSize);
+        }
+
+        void onUDPSocketWriteError(SocketErrorType /*errorType*/) override {}
+
+        void onTransportKnobApplied(TransportKnobParamId /*knobType*/) override {}
+
+        void onTransportKnobError(TransportKnobParamId /*knobType*/) override {}
+
+        void onTransportKnobOutOfOrder(TransportKnobParamId /*knobType*/) override {}
+
+        void onServerUnfinishedHandshake() override {}
+
+        void onZeroRttBuffered() override {}
+
+        void onZeroRttBufferedPruned() override {}
+
+        void onZeroRttAccepted() override
+        {
+            bump(counters.zeroRttAccepted);
+        }
+
+        void onZeroRttRejected() override
+        {
+            bump(counters.zeroRttRejected);
+        }
+
+        void onZeroRttPrimingAccepted() override {}
+
+        void onZeroRttPrimingRejected() override {}
+
+        void onDatagramRead(size_t /*datagramSize*/) override {}
+
+        void onDatagramWrite(size_t /*datagramSize*/) override {}
+
+        void onDatagramDroppedOnWrite() override {}
+
+        void onDatagramDroppedOnRead() override {}
+
+        void onShortHeaderPadding(size_t /*padSize*/) override {}
+
+        void onPacerTimerLagged() override {}
+
+    private:
+        struct alignas(folly::hardware_destructive_interference_size) Counters
+        {
+            std::atomic<uint64_t> packetsReceived {0};
+            std::atomic<uint64_t> packetsSent {0};
+            std::atomic<uint64_t> packetsDropped {0};
+            std::atomic<uint64_t> packetsLost {0};
+            std::atomic<uint64_t> retransmissions {0};
+            std::atomic<uint64_t> ptos {0};
+            std::atomic<uint64_t> bytesRead {0};
+            std::atomic<uint64_t> bytesWritten {0};
+            std::atomic<uint64_t> newConnections {0};
+            std::atomic<uint64_t> closedConnections {0};
+            std::atomic<uint64_t> streamsOpened {0};
+            std::atomic<uint64_t> streamsClosed {0};
+            std::atomic<uint64_t> streamsReset {0};
+            std::atomic<uint64_t> zeroRttAccepted {0};
+            std::atomic<uint64_t> zeroRttRejected {0};
+        };
+
+        // Kept on its own cache lines, RTT samples arrive with every ack
+        struct alignas(folly::hardware_destructive_interference_size) RttHistogram
+        {
+            std::array<std::atomic<uint64_t>, kRttBucketBoundsUs.size() + 1> counts {};
+            std::atomic<uint64_t> sumUs {0};
+        };
+
+        // Single writer, see the class comment
+        static void bump(std::atomic<uint64_t>& counter, uint64_t value = 1) noexcept
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value,
+                          std::memory_order_relaxed);
+        }
+
+        static inline folly::Synchronized<std::vector<WorkerTransportStats*>> allStats;
+
+        folly::EventBase* eventBase = nullptr;
+        Counters counters;
+        RttHistogram rttHistogram;
+    };
+
+    // Called by QuicServer once per worker, on the worker's thread
+    class WorkerTransportStatsFactory : public quic::QuicTransportStatsCallbackFactory
+    {
+    public:
+        std::unique_ptr<quic::QuicTransportStatsCallback> make() override;
+    };
+}  // namespace quic::samples